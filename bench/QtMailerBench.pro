@@ -0,0 +1,26 @@
+QT       += core network
+QT       -= gui
+
+CONFIG += c++11 console thread
+CONFIG -= app_bundle
+
+TARGET = QtMailerBench
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+        addressbench.cpp \
+        allocationcounter.cpp \
+        base64bench.cpp \
+        commandbench.cpp \
+        ingressbench.cpp \
+        renderbench.cpp
+
+HEADERS  += benchmark.h
+
+LIBS += -L$$PWD/../lib/ -lQtMailer
+
+INCLUDEPATH += $$PWD/../src
+DEPENDPATH += $$PWD/../src
+
+PRE_TARGETDEPS += $$PWD/../lib/libQtMailer.a
@@ -0,0 +1,115 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QRegExp>
+#include <QStringList>
+
+#include "benchmark.h"
+#include "mailaddress.h"
+
+/// Addresses parsed per run
+#define ADDRESSBENCH_COUNT 1000000
+
+namespace {
+
+/// Mailer::validPureMailaddress() before MailAddress
+bool oldValidPureMailaddress(const QString &address)
+{
+    return address.contains(QRegExp(R"(^[A-Za-z0-9.!#$%&'*+-/=?^_`{|}~]+@[a-zA-Z0-9]+.[a-zA-Z]{2,4}$)"));
+}
+
+/// Mailer::validDecoratedAddress() before MailAddress
+bool oldValidDecoratedAddress(const QString &address)
+{
+    return address.contains(QRegExp(
+                                R"(^.*<[A-Za-z0-9.!#$%&'*+-/=?^_`{|}~]+@[a-zA-Z0-9]+.[a-zA-Z]{2,4}>\s*$)"
+                                ));
+}
+
+/// Mailer::pureMailaddressFromAddressstring() before MailAddress
+QString oldPureMailaddressFromAddressstring(const QString &addressstring)
+{
+    if (oldValidPureMailaddress(addressstring))
+        return addressstring;
+    if (!oldValidDecoratedAddress(addressstring))
+        return addressstring;
+    QString returnValue = addressstring;
+    returnValue.remove(QRegExp(R"(^.*<)"));
+    returnValue.remove(QRegExp(R"(>\s*$)"));
+    return returnValue;
+}
+
+} // namespace
+
+/**
+ * Extracts and validates ADDRESSBENCH_COUNT recepients with the old
+ * QRegExp path and with MailAddress
+ */
+void benchAddress()
+{
+    const char* const patterns[] = {
+        "user%1@example.com",
+        "First Last <first.last%1@example.org>",
+        "\"Last, First\" <user%1@mail.example.museum>",
+        "\"quoted local %1\"@example.net"
+    };
+    QStringList addresses;
+    addresses.reserve(ADDRESSBENCH_COUNT);
+    for (int i{0}; i < ADDRESSBENCH_COUNT; i++)
+        addresses.append(QString(patterns[i % 4]).arg(i));
+
+    int found{0};
+    qint64 nsecs = fastestRun([&](){
+        found = 0;
+        foreach (const QString& address, addresses)
+            found += oldPureMailaddressFromAddressstring(address).size();
+    });
+    report("address extract 1M", "QRegExp", double(nsecs) / 1000000, "ms");
+    nsecs = fastestRun([&](){
+        found = 0;
+        foreach (const QString& address, addresses)
+            found += MailAddress::addressPart(address).size();
+    });
+    report("address extract 1M", "MailAddress", double(nsecs) / 1000000, "ms");
+
+    nsecs = fastestRun([&](){
+        found = 0;
+        foreach (const QString& address, addresses)
+            found += oldValidPureMailaddress(address) || oldValidDecoratedAddress(address);
+    });
+    report("address validate 1M", "QRegExp", double(nsecs) / 1000000, "ms");
+    report("address validate 1M", "QRegExp", found, "valid");
+    nsecs = fastestRun([&](){
+        found = 0;
+        foreach (const QString& address, addresses)
+            found += MailAddress::isValidAddress(address) ||
+                     MailAddress::isValidDecoratedAddress(address);
+    });
+    report("address validate 1M", "MailAddress", double(nsecs) / 1000000, "ms");
+    report("address validate 1M", "MailAddress", found, "valid");
+}
@@ -0,0 +1,82 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QByteArray>
+#include <QString>
+
+#include "benchmark.h"
+#include "base64encoder.h"
+
+/// Largest input given to the old encoder, it needs quadratic time
+#define BASE64BENCH_OLDMAXSIZE  (16 * 1024 * 1024)
+
+/**
+ * The encoding of Mail::generateBase64FromFile() before Base64Encoder,
+ * without reading the file
+ */
+QString oldBase64Encode(const QByteArray& data)
+{
+    QString attachedFileInBase64 = QString::fromLatin1((data.toBase64()).data());
+    qint64 i{0};
+    while (i < attachedFileInBase64.count()){
+        attachedFileInBase64.insert(i, "\r\n");
+        i = i+78;
+    }
+    return attachedFileInBase64;
+}
+
+/**
+ * Encodes attachments from 1 KB to 500 MB with the old encoder and with
+ * Base64Encoder and reports the throughput
+ */
+void benchBase64()
+{
+    printf("Base64Encoder uses %s\n", Base64Encoder::implementation());
+    const qint64 sizes[] = {1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 500 * 1024 * 1024};
+    for (qint64 size : sizes){
+        QByteArray data(int(size), Qt::Uninitialized);
+        char* bytes = data.data();
+        for (quint32 i{0}; i < quint32(size); i++) bytes[i] = char(i * 7 + (i >> 11));
+        QString name = QString("base64 %1 KB").arg(size / 1024);
+        // small inputs are encoded many times per run to get measurable times
+        int repeat = int(qMax<qint64>(1, (16 * 1024 * 1024) / size));
+
+        if (size <= BASE64BENCH_OLDMAXSIZE){
+            qint64 nsecs = fastestRun([&](){
+                for (int i{0}; i < repeat; i++) oldBase64Encode(data);
+            });
+            report(name, "toBase64+insert", double(size) * repeat * 1000 / nsecs, "MB/s");
+        }
+        char* out = new char[Base64Encoder::encodedSize(size)];
+        qint64 nsecs = fastestRun([&](){
+            for (int i{0}; i < repeat; i++) Base64Encoder::encode(data.constData(), size, out);
+        });
+        report(name, "Base64Encoder", double(size) * repeat * 1000 / nsecs, "MB/s");
+        delete[] out;
+    }
+}
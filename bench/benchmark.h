@@ -0,0 +1,79 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QByteArray>
+#include <cstdio>
+
+/// Runs of a measurement, the fastest one is reported
+#define BENCHMARK_RUNS 5
+
+void benchBase64();
+void benchRender();
+void benchAddress();
+void benchIngress();
+void benchCommands();
+
+/// The encoding of Mail::generateBase64FromFile() before Base64Encoder
+QString oldBase64Encode(const QByteArray& data);
+
+/// Number of memory allocations since the start, -1 if they can't be counted
+qint64 allocations();
+
+/**
+ * Runs a function BENCHMARK_RUNS times
+ * @return nanoseconds of the fastest run
+ */
+template<typename Function>
+qint64 fastestRun(Function function)
+{
+    qint64 fastest{-1};
+    for (int i{0}; i < BENCHMARK_RUNS; i++){
+        QElapsedTimer timer;
+        timer.start();
+        function();
+        qint64 elapsed = timer.nsecsElapsed();
+        if (fastest < 0 || elapsed < fastest) fastest = elapsed;
+    }
+    return fastest;
+}
+
+/**
+ * Prints one line of results
+ */
+inline void report(const QString& name, const QString& variant, double value, const char* unit)
+{
+    printf("%-28s %-22s %14.2f %s\n", qPrintable(name), qPrintable(variant), value, unit);
+    fflush(stdout);
+}
+
+#endif // BENCHMARK_H
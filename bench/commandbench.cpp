@@ -0,0 +1,120 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+
+#include "benchmark.h"
+#include "smtpcommandwriter.h"
+
+/// Protocol turns (MAIL FROM, three RCPT TO and DATA) per run
+#define COMMANDBENCH_TURNS          20000
+/// Commands written per turn
+#define COMMANDBENCH_COMMANDSPERTURN 5
+
+namespace {
+
+/**
+ * Reads on the server side until everything written in this turn arrived
+ */
+void receive(QTcpSocket* peer, qint64 bytes)
+{
+    while (bytes > 0 && (peer->bytesAvailable() > 0 || peer->waitForReadyRead(1000)))
+        bytes -= peer->readAll().size();
+}
+
+} // namespace
+
+/**
+ * Writes the commands of a pipelined transaction over a loopback connection
+ * the way Mailer did before (a QString per command through a QTextStream,
+ * flushed after each) and through SmtpCommandWriter, flushed once per turn
+ */
+void benchCommands()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost)){
+        printf("Can't listen on the loopback interface\n");
+        return;
+    }
+    QTcpSocket client;
+    client.connectToHost(QHostAddress::LocalHost, server.serverPort());
+    if (!client.waitForConnected(1000) || !server.waitForNewConnection(1000)){
+        printf("Can't connect over the loopback interface\n");
+        return;
+    }
+    QTcpSocket* peer = server.nextPendingConnection();
+    const QString sender        = "sender@example.com";
+    const QString recepients[]  = {"first@example.com", "second@example.com", "third@example.org"};
+    const double  commands      = double(COMMANDBENCH_TURNS) * COMMANDBENCH_COMMANDSPERTURN;
+
+    QTextStream stream(&client);
+    qint64 nsecs = fastestRun([&](){
+        for (int i{0}; i < COMMANDBENCH_TURNS; i++){
+            qint64 written{0};
+            QString sendstring = "MAIL FROM:<" + sender + ">\r\n";
+            stream << sendstring;
+            stream.flush();
+            client.flush();
+            written += sendstring.size();
+            for (const QString& recepient : recepients){
+                sendstring = "RCPT TO:<" + recepient + ">\r\n";
+                stream << sendstring;
+                stream.flush();
+                client.flush();
+                written += sendstring.size();
+            }
+            sendstring = "DATA\r\n";
+            stream << sendstring;
+            stream.flush();
+            client.flush();
+            written += sendstring.size();
+            receive(peer, written);
+        }
+    });
+    report("commands over loopback", "QString+QTextStream", commands * 1000000000 / nsecs,
+           "commands/s");
+
+    SmtpCommandWriter writer;
+    writer.setDevice(&client);
+    nsecs = fastestRun([&](){
+        for (int i{0}; i < COMMANDBENCH_TURNS; i++){
+            writer.append("MAIL FROM:<").append(sender).append(">\r\n");
+            for (const QString& recepient : recepients)
+                writer.append("RCPT TO:<").append(recepient).append(">\r\n");
+            writer.append("DATA\r\n");
+            qint64 written = writer.flush();
+            client.flush();
+            receive(peer, written);
+        }
+    });
+    report("commands over loopback", "SmtpCommandWriter", commands * 1000000000 / nsecs,
+           "commands/s");
+}
@@ -0,0 +1,109 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QMutex>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "mailingress.h"
+
+/// Producer threads pushing mails at the same time
+#define INGRESSBENCH_PRODUCERS      16
+/// Mails pushed by every producer per run
+#define INGRESSBENCH_MAILSPERTHREAD 20000
+
+namespace {
+
+/**
+ * Runs the producers and one consumer taking the mails until all are there
+ * @param mail      the mail pushed
+ * @param push      called by the producers for every mail
+ * @param drain     called by the consumer, moves the mails pushed so far into its queue
+ */
+template<typename Push, typename Drain>
+void runProducers(const Mail& mail, Push push, Drain drain)
+{
+    const size_t total = size_t(INGRESSBENCH_PRODUCERS) * INGRESSBENCH_MAILSPERTHREAD;
+    std::deque<Mail> queue;
+    std::thread consumer([&](){
+        while (queue.size() < total){
+            drain(queue);
+            std::this_thread::yield();
+        }
+    });
+    std::vector<std::thread> producers;
+    for (int i{0}; i < INGRESSBENCH_PRODUCERS; i++){
+        producers.push_back(std::thread([&](){
+            for (int j{0}; j < INGRESSBENCH_MAILSPERTHREAD; j++) push(mail);
+        }));
+    }
+    for (std::thread& producer : producers) producer.join();
+    consumer.join();
+}
+
+} // namespace
+
+/**
+ * Hands mails from 16 producer threads to one consumer through a deque
+ * guarded by a QMutex (what callers of enqueueMail() had to do before) and
+ * through MailIngress
+ */
+void benchIngress()
+{
+    Mail mail("recepient@example.com", "sender@example.com", "Subject", "Body");
+    const double total = double(INGRESSBENCH_PRODUCERS) * INGRESSBENCH_MAILSPERTHREAD;
+    QString name = QString("enqueue %1 threads").arg(INGRESSBENCH_PRODUCERS);
+
+    QMutex              mutex;
+    std::deque<Mail>    locked;
+    qint64 nsecs = fastestRun([&](){
+        runProducers(mail,
+                     [&](const Mail& pushed){
+                         QMutexLocker locker(&mutex);
+                         locked.push_back(pushed);
+                     },
+                     [&](std::deque<Mail>& queue){
+                         QMutexLocker locker(&mutex);
+                         while (!locked.empty()){
+                             queue.push_back(locked.front());
+                             locked.pop_front();
+                         }
+                     });
+    });
+    report(name, "QMutex+deque", total * 1000000000 / nsecs, "mails/s");
+
+    MailIngress ingress;
+    nsecs = fastestRun([&](){
+        runProducers(mail,
+                     [&](const Mail& pushed){ ingress.push(pushed); },
+                     [&](std::deque<Mail>& queue){ ingress.drainInto(queue); });
+    });
+    report(name, "MailIngress", total * 1000000000 / nsecs, "mails/s");
+}
@@ -0,0 +1,75 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QCoreApplication>
+#include <QStringList>
+
+#include "benchmark.h"
+
+/**
+  * Runs the benchmarks of QtMailer comparing the new code paths with the
+  * ones they replaced. Without arguments all benchmarks run, otherwise the
+  * ones named.
+  *
+  *     % ./QtMailerBench base64
+  */
+
+/// A benchmark and the name to select it with
+struct Benchmark {
+    const char* name;
+    void        (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    {"base64",      benchBase64},
+    {"render",      benchRender},
+    {"address",     benchAddress},
+    {"ingress",     benchIngress},
+    {"commands",    benchCommands}
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList selected = app.arguments().mid(1);
+
+    bool found{false};
+    for (const Benchmark& benchmark : benchmarks){
+        if (!selected.isEmpty() && !selected.contains(QLatin1String(benchmark.name))) continue;
+        found = true;
+        printf("== %s\n", benchmark.name);
+        benchmark.run();
+    }
+    if (!found){
+        printf("Unknown benchmark, available are:");
+        for (const Benchmark& benchmark : benchmarks) printf(" %s", benchmark.name);
+        printf("\n");
+        return 1;
+    }
+    return 0;
+}
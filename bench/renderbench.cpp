@@ -0,0 +1,164 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QByteArray>
+#include <QFile>
+#include <QTemporaryFile>
+
+#include "benchmark.h"
+#include "attachmentcache.h"
+#include "mail.h"
+
+/// Mails rendered per run
+#define RENDERBENCH_MAILS 2000
+
+/**
+ * A Mail rendered the way Mail::plaintextMail() did before MailRenderer
+ */
+class OldMail : public Mail
+{
+public:
+    OldMail(const QStringList& toRecepients, const QString& sender, const QString& subject,
+            const QString& body, const QList<QFileInfo>& attachments) :
+        Mail(toRecepients, sender, subject, body, attachments) {}
+
+    QString oldPlaintextMail() const;
+};
+
+QString OldMail::oldPlaintextMail() const
+{
+    QString message;
+
+    // To- Cc- and Bcc-lines
+    if (!toRecepients.isEmpty())
+        message.append(recepientHeaderLineFromStringList("To: ", toRecepients));
+    if (!ccRecepients.isEmpty())
+        message.append(recepientHeaderLineFromStringList("Cc: ", ccRecepients));
+    if (!bccRecepients.isEmpty())
+        message.append(recepientHeaderLineFromStringList("Bcc: ", bccRecepients));
+
+    // Set From:-line
+    message.append("From: "+sender+"\r\n");
+    message.append("Subject: "+ subject +"\r\n");
+
+    // A multipart message is generated when we have attachments
+    if (!attachments.isEmpty()){
+        message.append("MIME-Version: 1.0\r\n");
+        message.append("Content-type: multipart/mixed; boundary=\"" BOUNDARY "\"\r\n\r\n");
+        message.append("--" BOUNDARY "\r\n");
+    }
+
+    // Messagebody
+    message.append("\r\n"+body+"\r\n");
+
+    // If we have attachments .... add them
+    if (!attachments.isEmpty()){
+        message.append("--" BOUNDARY "\r\n");
+        for (int i{0}; i < attachments.size(); i++){
+            message.append("Content-type: "+mimetypeForFile(attachments.at(i))+
+                           "; name="+attachments.at(i).fileName()+"\r\n");
+            message.append("Content-Transfer-Encoding: base64\r\n");
+            message.append("Content-Disposition: attachment; filename="+
+                           attachments.at(i).fileName()+"\r\n\r\n");
+            QFile file(attachments.at(i).absoluteFilePath());
+            file.open(QFile::ReadOnly);
+            message.append(oldBase64Encode(file.readAll()));
+            message.append("\r\n--" BOUNDARY);
+            if(i == attachments.size()-1) message.append("--");
+            message.append("\r\n");
+        }
+    }
+
+    //clean the string to fit rfc5321
+    message.replace( QString::fromLatin1( "\r\n." ), QString::fromLatin1( "\r\n.." ) );
+    if (message.right(2) != "\r\n") message.append("\r\n");
+    message.append(".\r\n");
+
+    return message;
+}
+
+/**
+ * Renders the same mail RENDERBENCH_MAILS times the old way (including the
+ * conversion to UTF-8 the QTextStream of Mailer did) and with MailRenderer
+ */
+static void benchMail(const QString& name, const OldMail& mail)
+{
+    qint64 before = allocations();
+    mail.oldPlaintextMail().toUtf8();
+    qint64 oldAllocations = allocations() - before;
+    before = allocations();
+    mail.renderedMail();
+    qint64 newAllocations = allocations() - before;
+    if (before >= 0){
+        report(name, "plaintextMail", double(oldAllocations), "allocations/mail");
+        report(name, "MailRenderer", double(newAllocations), "allocations/mail");
+    }
+
+    qint64 nsecs = fastestRun([&](){
+        for (int i{0}; i < RENDERBENCH_MAILS; i++) mail.oldPlaintextMail().toUtf8();
+    });
+    report(name, "plaintextMail", double(nsecs) / RENDERBENCH_MAILS / 1000, "us/mail");
+    nsecs = fastestRun([&](){
+        for (int i{0}; i < RENDERBENCH_MAILS; i++) mail.renderedMail();
+    });
+    report(name, "MailRenderer", double(nsecs) / RENDERBENCH_MAILS / 1000, "us/mail");
+}
+
+/**
+ * Renders a text mail and a mail with an attachment of 64 KB
+ */
+void benchRender()
+{
+    QStringList to;
+    to << "First Recepient <first@example.com>" << "second@example.com"
+       << "Third Recepient <third@example.org>";
+    QString body;
+    for (int i{0}; i < 64; i++){
+        body.append(QString("Line %1 of the body, long enough to be a usual line of text.\r\n").arg(i));
+        if (i % 16 == 0) body.append(".a line starting with a dot\r\n");
+    }
+
+    // measure the renderer, not the AttachmentCache
+    qint64 budget = AttachmentCache::memoryBudget();
+    AttachmentCache::setMemoryBudget(0);
+
+    benchMail("render text", OldMail(to, "sender@example.com", "Subject", body,
+                                     QList<QFileInfo>()));
+
+    QTemporaryFile attachment;
+    if (attachment.open()){
+        QByteArray content(64 * 1024, Qt::Uninitialized);
+        for (int i{0}; i < content.size(); i++) content[i] = char(i * 13 + (i >> 7));
+        attachment.write(content);
+        attachment.flush();
+        benchMail("render 64 KB attachment", OldMail(to, "sender@example.com", "Subject", body,
+                                                     QList<QFileInfo>() << QFileInfo(attachment)));
+    }
+
+    AttachmentCache::setMemoryBudget(budget);
+}
@@ -1,7 +1,9 @@
 TEMPLATE = subdirs
-SUBDIRS = src examples
+SUBDIRS = src examples bench
 
 CONFIG += ordered
 src.file        = src/QtMailer.pro
 examples.file   = examples/examples.pro
 examples.depends = src
+bench.file      = bench/QtMailerBench.pro
+bench.depends   = src
@@ -12,14 +12,48 @@ CONFIG      +=  qt
 CONFIG      +=  staticlib
 CONFIG      +=  c++11
 
-HEADERS     =   mail.h \
+HEADERS     =   attachmentcache.h \
+                base64encoder.h \
+                hostcache.h \
+                hostlookup.h \
+                mail.h \
+                mailaddress.h \
                 mailer.h \
+                mailerpool.h \
+                mailingress.h \
+                mailrenderer.h \
+                mailspool.h \
+                mailstream.h \
+                mailtemplate.h \
                 mailerstatus.h \
-                mailerstatusStrings.h
+                mailerstatusStrings.h \
+                mimetypecache.h \
+                retryscheduler.h \
+                smtpcapabilities.h \
+                smtpcommandwriter.h \
+                smtpreplyparser.h \
+                tlssessioncache.h
 
-SOURCES     =   mail.cpp \
+SOURCES     =   attachmentcache.cpp \
+                base64encoder.cpp \
+                hostcache.cpp \
+                hostlookup.cpp \
+                mail.cpp \
+                mailaddress.cpp \
                 mailer.cpp \
-                mailerstatus.cpp
+                mailerpool.cpp \
+                mailingress.cpp \
+                mailrenderer.cpp \
+                mailspool.cpp \
+                mailstream.cpp \
+                mailtemplate.cpp \
+                mailerstatus.cpp \
+                mimetypecache.cpp \
+                retryscheduler.cpp \
+                smtpcapabilities.cpp \
+                smtpcommandwriter.cpp \
+                smtpreplyparser.cpp \
+                tlssessioncache.cpp
 
 unix {
     isEmpty(PREFIX){
@@ -0,0 +1,161 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "attachmentcache.h"
+
+/**
+  * @class AttachmentCache
+  *
+  * @brief Process-wide cache for base64 encoded attachments.
+  *
+  * When the same file is attached to many mails it is encoded once and all
+  * mails share the same immutable buffer. Entries are found by path, size
+  * and modification time of the file, so a changed file is encoded again.
+  *
+  * The cache holds at most memoryBudget() bytes and drops the least recently
+  * used files first. Files whose encoded size is more than a quarter of the
+  * budget are not cached at all; they are streamed by MailStream instead.
+  *
+  * The cache can be used from several threads.
+  */
+
+
+/**
+ * The encoded content of a file as produced by Base64Encoder, from the cache
+ * if the file didn't change since it was encoded last.
+ * @param fileinfo  the file
+ * @return the encoded file, a null QByteArray if the file is too large to be
+ *         cached or can't be read
+ */
+QByteArray AttachmentCache::encoded(const QFileInfo &fileinfo)
+{
+    // don't trust a QFileInfo which may have been created long ago
+    QFileInfo current(fileinfo.absoluteFilePath());
+    // files in /proc claim to be empty and change with every read
+    if (!current.isFile() || current.size() == 0) return QByteArray();
+    QString key = current.absoluteFilePath() + QLatin1Char('\n') + QString::number(current.size()) +
+                  QLatin1Char('\n') + QString::number(current.lastModified().toMSecsSinceEpoch());
+
+    Cache& shared = cache();
+    {
+        QMutexLocker locker(&shared.mutex);
+        QHash<QString, Entry>::iterator entry = shared.entries.find(key);
+        if (entry != shared.entries.end()){
+            shared.recentlyUsed.splice(shared.recentlyUsed.begin(), shared.recentlyUsed,
+                                       entry.value().use);
+            return entry.value().data;
+        }
+        if (Base64Encoder::encodedSize(current.size()) > shared.budget / 4) return QByteArray();
+    }
+
+    QFile file(current.absoluteFilePath());
+    if (!file.open(QFile::ReadOnly)) return QByteArray();
+    qint64 size = file.size();
+    uchar* mapped = (size > 0) ? file.map(0, size) : nullptr;
+    QByteArray data = mapped ? Base64Encoder::encode(reinterpret_cast<const char*>(mapped), size)
+                             : Base64Encoder::encode(file.readAll());
+    file.close();
+
+    QMutexLocker locker(&shared.mutex);
+    if (shared.entries.contains(key)) return shared.entries.value(key).data;
+    evict(shared, shared.budget - data.size());
+    Entry entry;
+    entry.data = data;
+    shared.recentlyUsed.push_front(key);
+    entry.use  = shared.recentlyUsed.begin();
+    shared.entries.insert(key, entry);
+    shared.used += data.size();
+    return data;
+}
+
+
+/**
+ * @return maximum number of bytes held by the cache
+ */
+qint64 AttachmentCache::memoryBudget()
+{
+    QMutexLocker locker(&cache().mutex);
+    return cache().budget;
+}
+
+
+/**
+ * Sets the maximum number of bytes held by the cache, 0 disables it
+ * @param bytes memory budget
+ */
+void AttachmentCache::setMemoryBudget(qint64 bytes)
+{
+    if (bytes < 0) return;
+    Cache& shared = cache();
+    QMutexLocker locker(&shared.mutex);
+    shared.budget = bytes;
+    evict(shared, bytes);
+}
+
+
+/**
+ * @return number of bytes currently held by the cache
+ */
+qint64 AttachmentCache::memoryUsed()
+{
+    QMutexLocker locker(&cache().mutex);
+    return cache().used;
+}
+
+
+/**
+ * Drops all cached attachments. Buffers still used by mails stay valid.
+ */
+void AttachmentCache::clear()
+{
+    Cache& shared = cache();
+    QMutexLocker locker(&shared.mutex);
+    evict(shared, 0);
+}
+
+
+AttachmentCache::Cache& AttachmentCache::cache()
+{
+    static Cache shared;
+    return shared;
+}
+
+
+/**
+ * Drops the least recently used entries until at most budget bytes are used.
+ * The mutex has to be locked.
+ */
+void AttachmentCache::evict(Cache &cache, qint64 budget)
+{
+    while (cache.used > budget && !cache.recentlyUsed.empty()){
+        QHash<QString, Entry>::iterator entry = cache.entries.find(cache.recentlyUsed.back());
+        cache.used -= entry.value().data.size();
+        cache.entries.erase(entry);
+        cache.recentlyUsed.pop_back();
+    }
+}
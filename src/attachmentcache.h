@@ -0,0 +1,74 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ATTACHMENTCACHE_H
+#define ATTACHMENTCACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <list>
+
+#include "base64encoder.h"
+
+#define ATTACHMENTCACHE_BUDGET  (64*1024*1024)
+
+class AttachmentCache
+{
+public:
+    static QByteArray   encoded(const QFileInfo& fileinfo);
+    static qint64       memoryBudget();
+    static void         setMemoryBudget(qint64 bytes);
+    static qint64       memoryUsed();
+    static void         clear();
+
+private:
+    /// An encoded file and its place in the list of recently used files
+    struct Entry {
+        QByteArray                      data;
+        std::list<QString>::iterator    use;
+    };
+
+    /// The state shared by all users of the cache
+    struct Cache {
+        QMutex                  mutex;
+        QHash<QString, Entry>   entries;
+        std::list<QString>      recentlyUsed;   ///< most recently used first
+        qint64                  budget{ATTACHMENTCACHE_BUDGET};
+        qint64                  used{0};
+    };
+
+    static Cache&       cache();
+    static void         evict(Cache& cache, qint64 budget);
+};
+
+#endif // ATTACHMENTCACHE_H
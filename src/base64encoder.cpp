@@ -0,0 +1,284 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "base64encoder.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64ENCODER_X86
+#include <immintrin.h>
+#endif
+
+/**
+  * @class Base64Encoder
+  *
+  * @brief Encodes attachments in base64 with the line breaks already in place.
+  *
+  * The data is encoded in lines of 76 characters (57 bytes of input), every
+  * line preceded by CRLF, as used for the attachments in the mail. The result
+  * is written in one pass into a buffer of the exact size given by
+  * encodedSize().
+  *
+  * On x86 with gcc or clang the full lines are encoded with AVX2 or SSSE3 if
+  * the CPU supports it, chosen once at runtime. Everything else uses the
+  * plain implementation.
+  */
+
+
+namespace {
+
+const char base64Alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+/**
+ * Encodes size bytes without line breaks, padding the last group with '='
+ */
+inline char* encodePlain(const uchar* data, qint64 size, char* out)
+{
+    while (size >= 3){
+        quint32 group = (quint32(data[0]) << 16) | (quint32(data[1]) << 8) | data[2];
+        *out++ = base64Alphabet[(group >> 18) & 0x3f];
+        *out++ = base64Alphabet[(group >> 12) & 0x3f];
+        *out++ = base64Alphabet[(group >>  6) & 0x3f];
+        *out++ = base64Alphabet[ group        & 0x3f];
+        data += 3;
+        size -= 3;
+    }
+    if (size > 0){
+        quint32 group = quint32(data[0]) << 16;
+        if (size == 2) group |= quint32(data[1]) << 8;
+        *out++ = base64Alphabet[(group >> 18) & 0x3f];
+        *out++ = base64Alphabet[(group >> 12) & 0x3f];
+        *out++ = (size == 2) ? base64Alphabet[(group >> 6) & 0x3f] : '=';
+        *out++ = '=';
+    }
+    return out;
+}
+
+
+char* encodeLinesPlain(const uchar* data, qint64 size, char* out)
+{
+    while (size > 0){
+        qint64 length = qMin(size, qint64(BASE64_BYTESPERLINE));
+        *out++ = '\r';
+        *out++ = '\n';
+        out = encodePlain(data, length, out);
+        data += length;
+        size -= length;
+    }
+    return out;
+}
+
+
+#ifdef BASE64ENCODER_X86
+
+// The vectorized versions follow the approach of Wojciech Muła: the bytes
+// are shuffled so every 32 bit word holds one group of three, the four 6 bit
+// values are moved into separate bytes by two multiplications and are then
+// translated to ASCII by a table lookup of the offset for each value range.
+
+__attribute__((target("ssse3")))
+inline __m128i reshuffle128(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+
+__attribute__((target("ssse3")))
+inline __m128i translate128(__m128i in)
+{
+    const __m128i offsets = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                          -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    indices = _mm_sub_epi8(indices, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+    return _mm_add_epi8(in, _mm_shuffle_epi8(offsets, indices));
+}
+
+
+/**
+ * Encodes full lines with SSSE3: 12 bytes per step, reading 16
+ */
+__attribute__((target("ssse3")))
+char* encodeLinesSSSE3(const uchar* data, qint64 size, char* out)
+{
+    while (size >= BASE64_BYTESPERLINE){
+        *out++ = '\r';
+        *out++ = '\n';
+        for (int i{0}; i < 48; i += 12){
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), translate128(reshuffle128(in)));
+            out += 16;
+        }
+        out = encodePlain(data + 48, BASE64_BYTESPERLINE - 48, out);
+        data += BASE64_BYTESPERLINE;
+        size -= BASE64_BYTESPERLINE;
+    }
+    return encodeLinesPlain(data, size, out);
+}
+
+
+__attribute__((target("avx2")))
+inline __m256i reshuffle256(__m256i in)
+{
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                                 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t1, t3);
+}
+
+
+__attribute__((target("avx2")))
+inline __m256i translate256(__m256i in)
+{
+    const __m256i offsets = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                             -4, -4, -4, -4, -19, -16, 0, 0,
+                                             65, 71, -4, -4, -4, -4, -4, -4,
+                                             -4, -4, -4, -4, -19, -16, 0, 0);
+    __m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+    indices = _mm256_sub_epi8(indices, _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25)));
+    return _mm256_add_epi8(in, _mm256_shuffle_epi8(offsets, indices));
+}
+
+
+/**
+ * Encodes full lines with AVX2: 24 bytes per step, each 128 bit lane loaded
+ * with 16 bytes of which 12 are used
+ */
+__attribute__((target("avx2")))
+char* encodeLinesAVX2(const uchar* data, qint64 size, char* out)
+{
+    while (size >= BASE64_BYTESPERLINE){
+        *out++ = '\r';
+        *out++ = '\n';
+        for (int i{0}; i < 48; i += 24){
+            __m128i low  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 12));
+            __m256i in   = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), translate256(reshuffle256(in)));
+            out += 32;
+        }
+        out = encodePlain(data + 48, BASE64_BYTESPERLINE - 48, out);
+        data += BASE64_BYTESPERLINE;
+        size -= BASE64_BYTESPERLINE;
+    }
+    return encodeLinesPlain(data, size, out);
+}
+
+#endif // BASE64ENCODER_X86
+
+} // namespace
+
+
+/**
+ * Size of the encoded data including the CRLF in front of every line
+ * @param size  number of bytes to encode
+ * @return encoded size
+ */
+qint64 Base64Encoder::encodedSize(qint64 size)
+{
+    qint64 lines = (size + BASE64_BYTESPERLINE - 1) / BASE64_BYTESPERLINE;
+    return 4 * ((size + 2) / 3) + 2 * lines;
+}
+
+
+/**
+ * Encodes data in lines of 76 characters each preceded by CRLF
+ * @param data  data to encode
+ * @return encoded data
+ */
+QByteArray Base64Encoder::encode(const QByteArray &data)
+{
+    return encode(data.constData(), data.size());
+}
+
+
+/**
+ * Encodes data in lines of 76 characters each preceded by CRLF
+ * @param data  data to encode
+ * @param size  number of bytes to encode
+ * @return encoded data
+ */
+QByteArray Base64Encoder::encode(const char *data, qint64 size)
+{
+    QByteArray result;
+    result.resize(encodedSize(size));
+    encode(data, size, result.data());
+    return result;
+}
+
+
+/**
+ * Encodes data in lines of 76 characters each preceded by CRLF into a buffer
+ * of at least encodedSize(size) bytes.
+ * @param data  data to encode
+ * @param size  number of bytes to encode
+ * @param out   buffer to write to
+ * @return pointer behind the last written character
+ */
+char* Base64Encoder::encode(const char *data, qint64 size, char *out)
+{
+    static const EncodeFunction function = encodeFunction();
+    return function(reinterpret_cast<const uchar*>(data), size, out);
+}
+
+
+/**
+ * Name of the implementation used on this CPU
+ * @return "avx2", "ssse3" or "plain"
+ */
+const char* Base64Encoder::implementation()
+{
+#ifdef BASE64ENCODER_X86
+    if (encodeFunction() == encodeLinesAVX2)    return "avx2";
+    if (encodeFunction() == encodeLinesSSSE3)   return "ssse3";
+#endif
+    return "plain";
+}
+
+
+/**
+ * Chooses the fastest implementation supported by the CPU
+ * @return encoding function
+ */
+Base64Encoder::EncodeFunction Base64Encoder::encodeFunction()
+{
+#ifdef BASE64ENCODER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))     return encodeLinesAVX2;
+    if (__builtin_cpu_supports("ssse3"))    return encodeLinesSSSE3;
+#endif
+    return encodeLinesPlain;
+}
@@ -0,0 +1,192 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hostcache.h"
+
+/**
+  * @class HostCache
+  *
+  * @brief Process-wide cache for the addresses of mailservers and the own hostname.
+  *
+  * Mailer looks up the addresses of its server with lookup() as soon as the
+  * server is set and keeps the result here for the time to live given by the
+  * DNS (at most HOSTCACHE_MAXTTL seconds). Sessions connecting to the same
+  * server later don't have to wait for the DNS again, sessions asking while
+  * a lookup is running share it.
+  *
+  * The lookups ask the nameserver set with setNameserver(), or the one of the
+  * system if none is set. Addresses can also be inserted directly.
+  *
+  * The hostname sent with EHLO is read only once per process.
+  *
+  * The cache can be used from several threads.
+  */
+
+
+/**
+ * Cached addresses of a host
+ * @param host  hostname as given to the Mailer
+ * @return addresses which haven't expired yet, empty if there are none
+ */
+QList<QHostAddress> HostCache::addresses(const QString &host)
+{
+    QMutexLocker locker(&mutex());
+    QHash<QString, Entry>::iterator entry = cache().find(host.toLower());
+    if (entry == cache().end()) return QList<QHostAddress>();
+    if (entry.value().expires <= QDateTime::currentMSecsSinceEpoch()){
+        cache().erase(entry);
+        return QList<QHostAddress>();
+    }
+    return entry.value().addresses;
+}
+
+
+/**
+ * Remembers the addresses of a host
+ * @param host      hostname
+ * @param addresses addresses of the host, nothing is stored if empty
+ * @param ttl       time to live in seconds
+ */
+void HostCache::insert(const QString &host, const QList<QHostAddress> &addresses, quint32 ttl)
+{
+    if (addresses.isEmpty() || ttl == 0) return;
+    Entry entry;
+    entry.addresses = addresses;
+    entry.expires   = QDateTime::currentMSecsSinceEpoch() +
+                      qint64(qMin<quint32>(ttl, HOSTCACHE_MAXTTL)) * 1000;
+
+    QMutexLocker locker(&mutex());
+    if (cache().size() >= HOSTCACHE_MAXENTRIES) cache().clear();
+    cache().insert(host.toLower(), entry);
+}
+
+
+/**
+ * Looks up the IPv4- and IPv6-addresses of a host using the configured
+ * nameserver. If a lookup for the host is running already, no new one is
+ * started. The addresses are in the cache when the lookup calls back, none
+ * if it failed.
+ * @param host      hostname to look up
+ * @param receiver  object to call back
+ * @param member    slot taking the hostname, called when the lookup is finished
+ */
+void HostCache::lookup(const QString &host, QObject *receiver, const char *member)
+{
+    QMutexLocker locker(&mutex());
+    HostLookup* running = runningLookups().value(host.toLower());
+    bool        started = !running;
+    if (started){
+        running = new HostLookup(host.toLower());
+        runningLookups().insert(host.toLower(), running);
+    }
+    QObject::connect(running, SIGNAL(finished(QString)), receiver, member, Qt::UniqueConnection);
+    locker.unlock();
+    if (started) running->start();
+}
+
+
+/**
+ * Called by a HostLookup before it calls back, later callers start a new one
+ * @param host  hostname which has been looked up
+ */
+void HostCache::lookupFinished(const QString &host)
+{
+    QMutexLocker locker(&mutex());
+    runningLookups().remove(host);
+}
+
+
+/**
+ * Sets the nameserver used by the following lookups
+ * @param nameserver address of the nameserver, a null address for the one of the system
+ */
+void HostCache::setNameserver(const QHostAddress &nameserver)
+{
+    QMutexLocker locker(&mutex());
+    configuredNameserver() = nameserver;
+}
+
+
+/**
+ * Returns the nameserver used for lookups
+ * @return address of the nameserver, a null address for the one of the system
+ */
+QHostAddress HostCache::nameserver()
+{
+    QMutexLocker locker(&mutex());
+    return configuredNameserver();
+}
+
+
+/**
+ * Name of the local host, read once per process
+ * @return the hostname to send with EHLO
+ */
+QString HostCache::localHostName()
+{
+    static const QString hostname = QHostInfo::localHostName();
+    return hostname;
+}
+
+
+/**
+ * Forgets all cached addresses
+ */
+void HostCache::clear()
+{
+    QMutexLocker locker(&mutex());
+    cache().clear();
+}
+
+
+QMutex& HostCache::mutex()
+{
+    static QMutex cacheMutex;
+    return cacheMutex;
+}
+
+
+QHash<QString, HostCache::Entry>& HostCache::cache()
+{
+    static QHash<QString, Entry> hosts;
+    return hosts;
+}
+
+
+QHostAddress& HostCache::configuredNameserver()
+{
+    static QHostAddress server;
+    return server;
+}
+
+
+QHash<QString, HostLookup*>& HostCache::runningLookups()
+{
+    static QHash<QString, HostLookup*> lookups;
+    return lookups;
+}
@@ -0,0 +1,77 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HOSTCACHE_H
+#define HOSTCACHE_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QDateTime>
+
+#include "hostlookup.h"
+
+/// Longest time in seconds an address is kept, even if the DNS says longer
+#define HOSTCACHE_MAXTTL 3600
+/// Number of hosts remembered before the cache is cleared
+#define HOSTCACHE_MAXENTRIES 256
+
+class HostCache
+{
+    friend class HostLookup;
+
+public:
+    static QList<QHostAddress>  addresses(const QString& host);
+    static void                 insert(const QString& host, const QList<QHostAddress>& addresses,
+                                       quint32 ttl);
+    static void                 lookup(const QString& host, QObject* receiver,
+                                       const char* member);
+    static void                 setNameserver(const QHostAddress& nameserver);
+    static QHostAddress         nameserver();
+    static QString              localHostName();
+    static void                 clear();
+
+private:
+    /// Addresses of one host and when they expire (msecs since epoch)
+    struct Entry {
+        QList<QHostAddress> addresses;
+        qint64              expires{0};
+    };
+
+    static QMutex&                  mutex();
+    static QHash<QString, Entry>&   cache();
+    static QHostAddress&            configuredNameserver();
+    static QHash<QString, HostLookup*>& runningLookups();
+    static void                     lookupFinished(const QString& host);
+};
+
+#endif // HOSTCACHE_H
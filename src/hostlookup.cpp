@@ -0,0 +1,103 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hostlookup.h"
+#include "hostcache.h"
+
+/**
+  * @class HostLookup
+  *
+  * @brief Looks up the IPv4- and IPv6-addresses of a host for the HostCache.
+  *
+  * The A- and AAAA-records are asked for at the same time using the
+  * nameserver of the HostCache. When both answers are in, the addresses are
+  * inserted into the cache (IPv4 first) with the shortest time to live of
+  * the records, finished() is emitted and the lookup deletes itself.
+  *
+  * Lookups are created by HostCache::lookup() only, which shares one
+  * running lookup among all callers asking for the same host.
+  */
+
+
+/**
+ * Constructor
+ * @param host      hostname to look up
+ * @param parent    Qt parent object if present
+ */
+HostLookup::HostLookup(const QString &host, QObject *parent) :
+    QObject(parent), host{host}, ttl{HOSTCACHE_MAXTTL}
+{
+}
+
+
+/**
+ * Starts the lookups of the A- and AAAA-records
+ */
+void HostLookup::start()
+{
+    QHostAddress nameserver = HostCache::nameserver();
+    QList<QDnsLookup::Type> types;
+    types << QDnsLookup::A << QDnsLookup::AAAA;
+    foreach (QDnsLookup::Type type, types){
+        QDnsLookup* lookup = new QDnsLookup(type, host, this);
+        if (!nameserver.isNull()) lookup->setNameserver(nameserver);
+        connect(
+                lookup,
+                SIGNAL(finished()),
+                this,
+                SLOT(recordsReceived())
+                );
+        pending++;
+        lookup->lookup();
+    }
+}
+
+
+/**
+ * Called when one of the lookups is finished. Stores the addresses in the
+ * HostCache after the last one.
+ */
+void HostLookup::recordsReceived()
+{
+    QDnsLookup* lookup = qobject_cast<QDnsLookup*>(sender());
+    if (lookup && lookup->error() == QDnsLookup::NoError){
+        foreach (const QDnsHostAddressRecord& record, lookup->hostAddressRecords()){
+            if (record.value().protocol() == QAbstractSocket::IPv6Protocol)
+                ipv6.append(record.value());
+            else
+                ipv4.append(record.value());
+            ttl = qMin(ttl, record.timeToLive());
+        }
+    }
+    if (--pending > 0) return;
+
+    HostCache::insert(host, ipv4 + ipv6, ttl);
+    HostCache::lookupFinished(host);
+    emit finished(host);
+    deleteLater();
+}
@@ -27,6 +27,8 @@
  */
 
 #include "mail.h"
+#include "mailrenderer.h"
+#include "mailstream.h"
 
 /**
   * @class Mail
@@ -105,7 +107,11 @@ Mail::Mail(const QString& toRecepient, const QString& sender, const QString& sub
 Mail::Mail(const Mail &other) :
     QObject(other.parent()), toRecepients{other.toRecepients}, ccRecepients{other.ccRecepients},
     bccRecepients{other.bccRecepients}, sender{other.sender}, subject{other.subject},
-    body{other.body}, attachments{other.attachments}
+    body{other.body}, attachments{other.attachments},
+    attachmentMimetypes{other.attachmentMimetypes}, extensionMimetypes{other.extensionMimetypes},
+    templateSegments{other.templateSegments}, templateValues{other.templateValues},
+    templateStuffedDots{other.templateStuffedDots}, spoolId{other.spoolId},
+    envelopeRecepients{other.envelopeRecepients}
 {
 }
 
@@ -116,57 +122,58 @@ Mail::Mail(const Mail &other) :
  * This string can be given to an smtp-server after DATA. All lines should be folded as needed
  * according to rfc5321. ^^
  *
+ * Mailer doesn't use this any more but streams the same data using MailStream
+ * to keep attachments out of memory.
+ *
  * @return String holding the raw maildata
  */
 QString Mail::plaintextMail() const
 {
-    QString message;
-
-    // To- Cc- and Bcc-lines
-    if (!toRecepients.isEmpty())
-        message.append(recepientHeaderLineFromStringList("To: ", toRecepients));
-    if (!ccRecepients.isEmpty())
-        message.append(recepientHeaderLineFromStringList("Cc: ", ccRecepients));
-    if (!bccRecepients.isEmpty())
-        message.append(recepientHeaderLineFromStringList("Bcc: ", bccRecepients));
+    return QString::fromUtf8(renderedMail());
+}
 
-    // Set From:-line
-    message.append("From: "+sender+"\r\n");
-    message.append("Subject: "+ subject +"\r\n"); // folding seems to insert whitespaces?! So omitted
 
-    // A multipart message is generated when we have attachments
-    if (!attachments.isEmpty()){
-        message.append("MIME-Version: 1.0\r\n");
-        message.append("Content-type: multipart/mixed; boundary=\"" BOUNDARY "\"\r\n\r\n");
-        message.append("--" BOUNDARY "\r\n");
+/**
+ * The exact size of the mail as declared with SIZE, calculated from the
+ * sizes of the attachments and the lengths of the headers without encoding
+ * anything. As rfc1870 demands the dots added by dot-stuffing are not
+ * counted.
+ *
+ * @param binary    true for the size sent with BDAT (attachments unencoded),
+ *                  false for the size sent after DATA
+ * @return size in bytes without the terminating dot, -1 if an attachment
+ *         doesn't report its size (pipes and special files)
+ */
+qint64 Mail::size(bool binary) const
+{
+    if (binary) return MailStream(*this, MailStream::BDAT_TRANSFER).totalSize();
+    if (!templateSegments.isEmpty()){
+        qint64 rendered{0};
+        for (int i{0}; i < templateSegments.size(); i++)
+            rendered += templateValues.at(i).size() + templateSegments.at(i).size();
+        return rendered - 3 - templateStuffedDots;
     }
+    qint64 rendered = MailRenderer(*this).size(false);
+    return rendered < 0 ? -1 : rendered - 3;
+}
 
-    // Messagebody
-    message.append("\r\n"+body+"\r\n");
 
-    // If we have attachments .... add them
-    if (!attachments.isEmpty()){
-        message.append("--" BOUNDARY "\r\n");
-        for (int i{0}; i < attachments.size(); i++){
-            message.append("Content-type: "+mimetypeForFile(attachments.at(i))+
-                           "; name="+attachments.at(i).fileName()+"\r\n");
-            message.append("Content-Transfer-Encoding: base64\r\n");
-            message.append("Content-Disposition: attachment; filename="+
-                           attachments.at(i).fileName()+"\r\n\r\n");
-            message.append(generateBase64FromFile(attachments.at(i)));
-            message.append("\r\n--" BOUNDARY);
-            if(i == attachments.size()-1) message.append("--");
-            message.append("\r\n");
-
-        }
+/**
+ * The raw maildata as UTF-8, rendered by MailRenderer in one pass into a
+ * buffer of the exact size. Mails created by a MailTemplate are put
+ * together from the rendered parts of the template.
+ *
+ * @return the raw maildata terminated by the single dot
+ */
+QByteArray Mail::renderedMail() const
+{
+    if (!templateSegments.isEmpty()){
+        QByteArray rendered;
+        for (int i{0}; i < templateSegments.size(); i++)
+            rendered.append(templateValues.at(i)).append(templateSegments.at(i));
+        return rendered;
     }
-
-    //clean the string to fit rfc5321
-    message.replace( QString::fromLatin1( "\r\n." ), QString::fromLatin1( "\r\n.." ) );
-    if (message.right(2) != "\r\n") message.append("\r\n");
-    message.append(".\r\n");
-
-    return message;
+    return MailRenderer(*this).render();
 }
 
 
@@ -192,6 +199,34 @@ QStringList Mail::getAllRecepients() const
 }
 
 
+/**
+ * Returns the recepients the mail is sent to with RCPT TO:
+ *
+ * These are all recepients unless setEnvelopeRecepients() restricted them.
+ *
+ * @return QStringList holding the recepients of the envelope
+ */
+QStringList Mail::getEnvelopeRecepients() const
+{
+    if (envelopeRecepients.isEmpty()) return getAllRecepients();
+    return envelopeRecepients;
+}
+
+
+/**
+ * Restricts the recepients the mail is sent to, without changing the To:-
+ * and Cc:-lines. Used to send the mail again only to the recepients the
+ * server didn't accept before. A spooled mail counts as a new mail afterwards.
+ *
+ * @param recepients recepients to send to, empty for all
+ */
+void Mail::setEnvelopeRecepients(const QStringList &recepients)
+{
+    envelopeRecepients  = recepients;
+    spoolId             = 0;
+}
+
+
 /**
  * All addresses from the To:-header
  * @return recepients
@@ -223,26 +258,159 @@ QStringList Mail::getBccRecepients() const
 
 
 /**
- * Generates a string repesentation in base64 of a file.
- *
- * @param fileinfo  fileinfo pointing to the file to transform
- * @return Stringrepresentation of the file
+ * All attached files
+ * @return attachments
+ */
+QList<QFileInfo> Mail::getAttachments() const
+{
+    return attachments;
+}
+
+
+/**
+ * Tests if two mails are sent with the same content and sender, so they can
+ * share one transaction. Bcc- and envelope-recepients don't matter.
+ * @param other the mail to compare with
+ * @return true if the rendered mails are the same
  */
-QString Mail::generateBase64FromFile(const QFileInfo& fileinfo) const
-{
-    QString attachedFileInBase64;
-    if (! fileinfo.exists()) return QString();
-
-    QFile file(fileinfo.absoluteFilePath());
-    file.open(QFile::ReadOnly);
-    attachedFileInBase64 = QString::fromLatin1((file.readAll().toBase64()).data());
-    qint64 i{0};
-    while (i < attachedFileInBase64.count()){
-        attachedFileInBase64.insert(i, "\r\n");
-        i = i+MAXLINESIZE;
+bool Mail::hasSameContent(const Mail &other) const
+{
+    if (attachments.size() != other.attachments.size()) return false;
+    for (int i{0}; i < attachments.size(); i++){
+        if (attachments.at(i).absoluteFilePath() != other.attachments.at(i).absoluteFilePath())
+            return false;
     }
-    file.close();
-    return attachedFileInBase64;
+    return sender               == other.sender &&
+           toRecepients         == other.toRecepients &&
+           ccRecepients         == other.ccRecepients &&
+           subject              == other.subject &&
+           body                 == other.body &&
+           attachmentMimetypes  == other.attachmentMimetypes &&
+           extensionMimetypes   == other.extensionMimetypes &&
+           templateValues       == other.templateValues &&
+           templateSegments     == other.templateSegments;
+}
+
+
+/**
+ * Hash over everything hasSameContent() compares
+ * @return hash value of the content
+ */
+uint Mail::contentHash() const
+{
+    uint hash = qHash(sender) ^ qHash(subject) ^ qHash(body);
+    // the segments of a template are the same for all of its mails
+    foreach (const QByteArray& value, templateValues)
+        hash = hash * 31 + qHash(value);
+    foreach (const QString& recepient, toRecepients + ccRecepients)
+        hash = hash * 31 + qHash(recepient);
+    foreach (const QFileInfo& attachment, attachments)
+        hash = hash * 31 + qHash(attachment.absoluteFilePath());
+    return hash;
+}
+
+
+/**
+ * Attaches a file to the mail
+ * @param attachment    the file to attach
+ * @param mimetype      mimetype of the file, looked up when sending if empty
+ */
+void Mail::addAttachment(const QFileInfo &attachment, const QString &mimetype)
+{
+    attachments.append(attachment);
+    if (!mimetype.isEmpty()) setAttachmentMimetype(attachment, mimetype);
+}
+
+
+/**
+ * Sets the mimetype of an attachment, so it doesn't need to be looked up
+ * @param attachment    the attached file
+ * @param mimetype      mimetype of the file, e.g. "application/pdf"
+ */
+void Mail::setAttachmentMimetype(const QFileInfo &attachment, const QString &mimetype)
+{
+    attachmentMimetypes.insert(attachment.absoluteFilePath(), mimetype);
+}
+
+
+/**
+ * Guess the mimetypes of the attachments from their filenames instead of
+ * reading their content.
+ */
+void Mail::useExtensionMimetypes(bool use)
+{
+    extensionMimetypes = use;
+}
+
+
+/**
+ * The headerlines of the mail including the start of the multipart message if
+ * the mail has attachments.
+ * @return headerlines
+ */
+QString Mail::headerPart() const
+{
+    QString header;
+
+    // To- and Cc-lines, Bcc-recepients are only part of the envelope (rfc5322 3.6.3)
+    if (!toRecepients.isEmpty())
+        header.append(recepientHeaderLineFromStringList("To: ", toRecepients));
+    if (!ccRecepients.isEmpty())
+        header.append(recepientHeaderLineFromStringList("Cc: ", ccRecepients));
+
+    // Set From:-line
+    header.append("From: "+sender+"\r\n");
+    header.append("Subject: "+ subject +"\r\n"); // folding seems to insert whitespaces?! So omitted
+
+    // A multipart message is generated when we have attachments
+    if (!attachments.isEmpty()){
+        header.append("MIME-Version: 1.0\r\n");
+        header.append("Content-type: multipart/mixed; boundary=\"" BOUNDARY "\"\r\n\r\n");
+        header.append("--" BOUNDARY "\r\n");
+    }
+    return header;
+}
+
+
+/**
+ * The messagebody followed by the boundary of the first attachment if present.
+ * @return messagebody
+ */
+QString Mail::bodyPart() const
+{
+    QString part = "\r\n"+body+"\r\n";
+    if (!attachments.isEmpty())
+        part.append("--" BOUNDARY "\r\n");
+    return part;
+}
+
+
+/**
+ * The MIME-headers in front of the data of an attachment
+ * @param fileinfo  the attached file
+ * @param binary    true if the file is sent unencoded (BINARYMIME, rfc3030)
+ * @return MIME-headers of the attachment
+ */
+QString Mail::attachmentHeader(const QFileInfo &fileinfo, bool binary) const
+{
+    return "Content-type: "+mimetypeForFile(fileinfo)+"; name="+fileinfo.fileName()+"\r\n"
+           "Content-Transfer-Encoding: "+(binary ? "binary" : "base64")+"\r\n"
+           "Content-Disposition: attachment; filename="+fileinfo.fileName()+"\r\n\r\n";
+}
+
+
+/**
+ * The boundary following the base64 data of an attachment, closing the
+ * multipart message after the last one.
+ * @param index index of the attachment
+ * @return boundary line
+ */
+QString Mail::attachmentTrailer(int index) const
+{
+    QString trailer = "\r\n--" BOUNDARY;
+    if (index == attachments.size()-1) trailer.append("--");
+    trailer.append("\r\n");
+    return trailer;
 }
 
 
@@ -274,14 +442,19 @@ QString Mail::foldString(const QString &original) const
 
 /**
  * MimeType for a file
+ *
+ * A mimetype set with setAttachmentMimetype() is used as is, otherwise it is
+ * looked up in the MimetypeCache.
+ *
  * @param fileinfo pointing to the file
  * @return mimetype of file
  */
 QString Mail::mimetypeForFile(const QFileInfo &fileinfo) const
 {
+    QString mimetype = attachmentMimetypes.value(fileinfo.absoluteFilePath());
+    if (!mimetype.isEmpty()) return mimetype;
     if (!fileinfo.exists()) return QString();
-    QMimeDatabase mimedatabase;
-    return mimedatabase.mimeTypeForFile(fileinfo).name();
+    return MimetypeCache::mimetypeForFile(fileinfo, extensionMimetypes);
 }
 
 
@@ -39,14 +39,23 @@
 #include <QMimeType>
 #include <QMimeDatabase>
 #include <QFileInfo>
+#include <QHash>
 #include <utility>
 
+#include "mimetypecache.h"
+
 #define MAXLINESIZE 78
 #define BOUNDARY    "mXysXimXplXebXouXndXarXy"
 
 class Mail : public QObject
 {
     Q_OBJECT
+
+    friend class MailStream;
+    friend class MailRenderer;
+    friend class MailTemplate;
+    friend class MailSpool;
+
 public:
     explicit Mail(const QStringList& toRecepients,
                   const QStringList& ccRecepients,
@@ -102,11 +111,23 @@ public:
     Mail(const Mail& other);
 
     QString             plaintextMail() const;
+    QByteArray          renderedMail() const;
+    qint64              size(bool binary = false) const;
     QString             getSender() const;
     QStringList         getAllRecepients() const;
+    QStringList         getEnvelopeRecepients() const;
+    void                setEnvelopeRecepients(const QStringList& recepients);
     QStringList         getToRecepients() const;
     QStringList         getCcRecepients() const;
     QStringList         getBccRecepients() const;
+    QList<QFileInfo>    getAttachments() const;
+    bool                hasSameContent(const Mail& other) const;
+    uint                contentHash() const;
+    void                addAttachment(const QFileInfo& attachment,
+                                      const QString& mimetype = QString());
+    void                setAttachmentMimetype(const QFileInfo& attachment,
+                                              const QString& mimetype);
+    void                useExtensionMimetypes(bool use = true);
     std::pair<int,int>  lastErrors() const;
 
 protected:
@@ -117,8 +138,18 @@ protected:
     QString             subject;
     QString             body;
     QList<QFileInfo>    attachments;
+    QHash<QString, QString> attachmentMimetypes;
+    bool                extensionMimetypes{false};
+    QList<QByteArray>   templateSegments;       ///< set by MailTemplate, shared with it
+    QList<QByteArray>   templateValues;         ///< set by MailTemplate, sent before each segment
+    int                 templateStuffedDots{0}; ///< set by MailTemplate, added by dot-stuffing
+    quint64             spoolId{0};             ///< set by MailSpool
+    QStringList         envelopeRecepients;     ///< RCPT TO: if not all recepients
 
-    QString         generateBase64FromFile(const QFileInfo&) const;
+    QString         headerPart() const;
+    QString         bodyPart() const;
+    QString         attachmentHeader(const QFileInfo& fileinfo, bool binary = false) const;
+    QString         attachmentTrailer(int index) const;
     QString         foldString(const QString& original) const;
     QString         mimetypeForFile(const QFileInfo& file) const;
     QString         recepientHeaderLineFromStringList(const QString& header,
@@ -0,0 +1,284 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailaddress.h"
+
+/**
+  * @class MailAddress
+  *
+  * @brief Parses mailaddresses as used in the envelope (rfc5321/rfc5322).
+  *
+  * Accepts plain addresses ("local@domain.tld") and addresses decorated with
+  * a display name ("My Name <local@domain.tld>"). The local part may be a
+  * dot-atom or a quoted string, the domain needs at least two labels and any
+  * top level domain of two or more characters.
+  *
+  * The character classes are looked up in a table built at compile time and
+  * nothing is allocated: addressPart() returns a reference into the string
+  * it got.
+  */
+
+
+namespace {
+
+/// Bits in the table of character classes
+enum CharClass {
+    ATEXT   = 0x01,     ///< may appear in a dot-atom
+    LDH     = 0x02,     ///< letter, digit or hyphen as used in domain labels
+    ALPHA   = 0x04,     ///< letter
+    QTEXT   = 0x08,     ///< may appear unescaped in a quoted string
+    VCHAR   = 0x10      ///< visible character, may be escaped in a quoted string
+};
+
+constexpr bool inList(int c, const char* list)
+{
+    return *list != 0 && (*list == c || inList(c, list + 1));
+}
+
+constexpr bool isAlpha(int c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+constexpr bool isDigit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr unsigned char classify(int c)
+{
+    return static_cast<unsigned char>(
+           ((isAlpha(c) || isDigit(c) || inList(c, "!#$%&'*+-/=?^_`{|}~")) ? ATEXT : 0) |
+           ((isAlpha(c) || isDigit(c) || c == '-')                         ? LDH   : 0) |
+           (isAlpha(c)                                                     ? ALPHA : 0) |
+           ((c == ' ' || (c >= 33 && c <= 126 && c != '"' && c != '\\'))   ? QTEXT : 0) |
+           ((c == ' ' || (c >= 33 && c <= 126))                            ? VCHAR : 0));
+}
+
+#define CLASSIFY4(c)    classify(c), classify(c+1), classify(c+2), classify(c+3)
+#define CLASSIFY16(c)   CLASSIFY4(c), CLASSIFY4(c+4), CLASSIFY4(c+8), CLASSIFY4(c+12)
+
+constexpr unsigned char charClasses[128] = {
+    CLASSIFY16(0),  CLASSIFY16(16), CLASSIFY16(32), CLASSIFY16(48),
+    CLASSIFY16(64), CLASSIFY16(80), CLASSIFY16(96), CLASSIFY16(112)
+};
+
+#undef CLASSIFY16
+#undef CLASSIFY4
+
+inline bool hasClass(QChar c, CharClass charClass)
+{
+    return c.unicode() < 128 && (charClasses[c.unicode()] & charClass);
+}
+
+} // namespace
+
+
+/**
+ * Returns the pure mailaddress of an addressstring as used by mailclients.
+ *
+ * For "Test user <testuser@example.com>" this is "testuser@example.com". A
+ * plain address or a string which can't be parsed is returned as is.
+ *
+ * @param addressstring address with or without display name
+ * @return reference to the mailaddress inside addressstring
+ */
+QStringRef MailAddress::addressPart(const QString &addressstring)
+{
+    if (isAddrSpec(addressstring.constData(), addressstring.size()))
+        return QStringRef(&addressstring);
+
+    int start, length;
+    if (angleAddress(addressstring, start, length))
+        return QStringRef(&addressstring, start, length);
+    return QStringRef(&addressstring);
+}
+
+
+/**
+ * Returns the domain of the mailaddress in an addressstring.
+ *
+ * For "Test user <testuser@example.com>" this is "example.com".
+ *
+ * @param addressstring address with or without display name
+ * @return reference to the domain inside addressstring, empty if there is no '@'
+ */
+QStringRef MailAddress::domainPart(const QString &addressstring)
+{
+    QStringRef address = addressPart(addressstring);
+    int at = address.lastIndexOf(QLatin1Char('@'));
+    if (at < 0) return QStringRef();
+    return address.mid(at + 1);
+}
+
+
+/**
+ * Tests if a string contains a valid plain mailaddress as in "local@domain.tld".
+ * @param address   the address to test.
+ * @return true if address is a valid plain mailaddress
+ */
+bool MailAddress::isValidAddress(const QString &address)
+{
+    return isAddrSpec(address.constData(), address.size());
+}
+
+
+/**
+ * Tests if a string contains a valid decorated mailaddress as in "My Name <local@domain.tld>".
+ * @param address   the address to test.
+ * @return true if address is a valid decorated mailaddress
+ */
+bool MailAddress::isValidDecoratedAddress(const QString &address)
+{
+    int start, length;
+    return angleAddress(address, start, length);
+}
+
+
+/**
+ * Tests if the characters form a mailaddress as in "local@domain.tld".
+ * @param address   first character of the address
+ * @param length    number of characters
+ * @return true if it is a valid address
+ */
+bool MailAddress::isAddrSpec(const QChar *address, int length)
+{
+    int at = localPartLength(address, length);
+    if (at <= 0 || at >= length || address[at] != QLatin1Char('@')) return false;
+    return isDomain(address + at + 1, length - at - 1);
+}
+
+
+/**
+ * Length of the local part of an address, either a dot-atom or a quoted string
+ * @param address   first character of the address
+ * @param length    number of characters
+ * @return length of the local part or -1 if it isn't valid
+ */
+int MailAddress::localPartLength(const QChar *address, int length)
+{
+    if (length == 0) return -1;
+
+    if (address[0] == QLatin1Char('"')){
+        for (int i{1}; i < length; i++){
+            if (address[i] == QLatin1Char('\\')){
+                if (i + 1 >= length || !hasClass(address[i + 1], VCHAR)) return -1;
+                i++;
+            } else if (address[i] == QLatin1Char('"')){
+                return i + 1;
+            } else if (!hasClass(address[i], QTEXT)){
+                return -1;
+            }
+        }
+        return -1;
+    }
+
+    bool afterDot{true};
+    int i{0};
+    for (; i < length && address[i] != QLatin1Char('@'); i++){
+        if (address[i] == QLatin1Char('.')){
+            if (afterDot) return -1;
+            afterDot = true;
+        } else if (hasClass(address[i], ATEXT)){
+            afterDot = false;
+        } else {
+            return -1;
+        }
+    }
+    return afterDot ? -1 : i;
+}
+
+
+/**
+ * Tests if the characters form a domain with at least two labels, the last
+ * one being a top level domain of at least two characters with a letter.
+ * @param domain    first character of the domain
+ * @param length    number of characters
+ * @return true if it is a valid domain
+ */
+bool MailAddress::isDomain(const QChar *domain, int length)
+{
+    if (length < 4 || length > 255) return false;
+
+    int labels{0};
+    int labelStart{0};
+    bool letterInLabel{false};
+    for (int i{0}; i <= length; i++){
+        if (i == length || domain[i] == QLatin1Char('.')){
+            int labelLength = i - labelStart;
+            if (labelLength < 1 || labelLength > 63)            return false;
+            if (domain[labelStart] == QLatin1Char('-'))         return false;
+            if (domain[i - 1] == QLatin1Char('-'))              return false;
+            labels++;
+            if (i == length) return labels >= 2 && labelLength >= 2 && letterInLabel;
+            labelStart      = i + 1;
+            letterInLabel   = false;
+        } else if (hasClass(domain[i], LDH)){
+            if (hasClass(domain[i], ALPHA)) letterInLabel = true;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Finds the address in angle brackets after a display name, the display name
+ * may contain quoted strings.
+ * @param addressstring address with display name
+ * @param start         set to the index of the address
+ * @param length        set to the length of the address
+ * @return true if there is a valid address in angle brackets at the end
+ */
+bool MailAddress::angleAddress(const QString &addressstring, int &start, int &length)
+{
+    const QChar* characters = addressstring.constData();
+    int end = addressstring.size();
+    while (end > 0 && characters[end - 1].isSpace()) end--;
+    if (end == 0 || characters[end - 1] != QLatin1Char('>')) return false;
+
+    int open{-1};
+    bool quoted{false};
+    for (int i{0}; i < end - 1; i++){
+        if (quoted){
+            if (characters[i] == QLatin1Char('\\'))     i++;
+            else if (characters[i] == QLatin1Char('"')) quoted = false;
+        } else if (characters[i] == QLatin1Char('"')){
+            quoted = true;
+        } else if (characters[i] == QLatin1Char('<')){
+            open = i;
+            break;
+        }
+    }
+    if (open < 0) return false;
+
+    start   = open + 1;
+    length  = end - 1 - start;
+    return isAddrSpec(characters + start, length);
+}
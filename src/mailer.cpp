@@ -50,7 +50,24 @@
   * communication errors with the server, the mails are put to the back of the
   * mailqueue if the error is temporary. You can than decide what to do with
   * them. In case of permanent errors the mail will be deleted and will never be
-  * seen again.
+  * seen again. With a RetryScheduler mails having temporary errors are held
+  * back and come back to the mailqueue when their retry is due.
+  *
+  * While the content of a mail is written to the server the class emits
+  * mailBytesSentTillNow(qint64, qint64). The content is read in small chunks
+  * from a MailStream only as fast as the socket gets rid of it, so even
+  * large attachments never have to fit into memory. The total is -1 if an
+  * attachment is a pipe or special file which doesn't report its size.
+  *
+  * With useKeepAlive() the session stays open after all mails are processed.
+  * It is kept alive with NOOP and closed after an idle timeout. Mails
+  * enqueued meanwhile are sent on it right away, and if the server has closed
+  * it a new session is opened for them without reporting an error.
+  *
+  * sendAllMailsAndWait() sends the mails and returns when all were processed
+  * or a deadline passed. The thread sleeps in an event loop in the meantime,
+  * so it can be used from a worker thread without a GUI as long as the Mailer
+  * lives in that thread. It returns the result for every mail.
   *
   * For any error that occures while processing the mailconnection the class
   * emits errorSendingMails(int, QString) which gives you the SMTP-Error-Code
@@ -69,6 +86,7 @@ Mailer::Mailer(const QString &server, QObject *parent) :
     QObject(parent), server{server}
 {
     socket = new QSslSocket(this);
+    commandWriter.setDevice(socket);
     connect(
              socket,
              SIGNAL(readyRead()),
@@ -88,33 +106,112 @@ Mailer::Mailer(const QString &server, QObject *parent) :
             this,
             SLOT(sslErrorsReceived(QList<QSslError>))
             );
+
+    connect(
+            socket,
+            SIGNAL(bytesWritten(qint64)),
+            this,
+            SLOT(contentBytesWritten(qint64))
+            );
+
+    connect(
+            socket,
+            SIGNAL(connected()),
+            this,
+            SLOT(connectionEstablished())
+            );
+
+    connect(
+            socket,
+            SIGNAL(encrypted()),
+            this,
+            SLOT(connectionEncrypted())
+            );
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    connect(
+            socket,
+            SIGNAL(newSessionTicketReceived()),
+            this,
+            SLOT(tlsSessionReceived())
+            );
+#endif
+
+    handshakeTimer = new QTimer(this);
+    handshakeTimer->setSingleShot(true);
+    connect(
+            handshakeTimer,
+            SIGNAL(timeout()),
+            this,
+            SLOT(handshakeTimedOut())
+            );
+
+    keepAliveTimer = new QTimer(this);
+    connect(
+            keepAliveTimer,
+            SIGNAL(timeout()),
+            this,
+            SLOT(sendNOOP())
+            );
+
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    connect(
+            idleTimer,
+            SIGNAL(timeout()),
+            this,
+            SLOT(idleTimedOut())
+            );
+
+    resolveServer();
 }
 
 
 /**
  * @brief Returns the number of mails beeing held in the mailqueue
+ *
+ * Can be called from any thread, the mails enqueued but not moved to the
+ * mailqueue yet are counted too.
+ *
  * @return the size oh the mailqueue
  */
 int Mailer::sizeOfQueue() const
 {
-    return mailqueue.size();
+    return queuedMails.load();
 }
 
 
 /**
  * Starts the process of sending all mails in the mailqueue
  *
+ * Returns right away, the connection is set up in the background. If it
+ * fails errorSendingMails() and finishedSending() are emitted. A session
+ * kept alive is used without connecting again.
+ *
  * @return false if mailqueue is empty or the mailer is alredy busy
  */
 bool Mailer::sendAllMails()
 {
 
     // Only start sending if we aren't busy
-    if (currentState != Disconnected)   return false;
+    if (isBusy())                       return false;
+    drainIngress();
     // don't send if we have no mails.
     if (mailqueue.size() == 0 )         return false;
 
+    if (coalescingUsed) groupIdenticalMails();
     mailsToSend = mailqueue.size();
+    results.clear();
+    tempErrors      = 0;
+    permErrors      = 0;
+
+    if (currentState == Idle){
+        keepAliveTimer->stop();
+        idleTimer->stop();
+        sessionReused = true;
+        sendMAILFROM();
+        return true;
+    }
 
     // And the magic begins...
     if (!connectToServer())             return false;
@@ -136,11 +233,56 @@ void Mailer::cancelSending()
 /**
  * Pushes a mailobject to the end of the mailqueue
  *
+ * Can be called from any thread without locking. The mail is passed through
+ * a lock-free MailIngress and moved to the mailqueue by drainIngress() in the
+ * thread of the Mailer.
+ *
  * @param mail  mailobject to enqueue
  */
 void Mailer::enqueueMail(const Mail &mail)
 {
-    mailqueue.push_back(mail);
+    queuedMails++;
+    ingress.push(mail);
+    // only the first mail since the last drain needs to wake up the mailer
+    if (ingressCount.fetch_add(1) == 0)
+        QMetaObject::invokeMethod(this, "drainIngress", Qt::QueuedConnection);
+}
+
+
+/**
+ * Moves the mails enqueued by enqueueMail() to the mailqueue. Runs in the
+ * thread of the Mailer.
+ *
+ * A mail may be counted before it can be drained, then this is tried again
+ * with the next pass of the event loop.
+ */
+void Mailer::drainIngress()
+{
+    int drained = ingress.drainInto(mailqueue);
+    if (spool){
+        for (size_t i{mailqueue.size() - drained}; i < mailqueue.size(); i++)
+            spool->store(mailqueue[i]);
+    }
+    if (ingressCount.fetch_sub(drained) - drained > 0)
+        QMetaObject::invokeMethod(this, "drainIngress", Qt::QueuedConnection);
+
+    if (!keepAliveUsed || drained == 0) return;
+    if (currentState == Idle || currentState == Disconnected)
+        QMetaObject::invokeMethod(this, "sendWaitingMails", Qt::QueuedConnection);
+    else
+        mailsWaiting = true;
+}
+
+
+/**
+ * Sends the mails enqueued while keeping the session alive, reconnects if
+ * the session was closed meanwhile.
+ */
+void Mailer::sendWaitingMails()
+{
+    if (!keepAliveUsed) return;
+    mailsWaiting = false;
+    sendAllMails();
 }
 
 
@@ -161,78 +303,277 @@ QString Mailer::getServer() const
  */
 void Mailer::setServer(const QString &value)
 {
+    if (value == server) return;
+    closeIdleSession(true);
     server = value;
+    serverRecepientLimit = 0;
+    capabilities = SmtpCapabilities();
+    serverLookup = false;
+    resolveServer();
 }
 
 
 /**
  * Returns true if the mailer ist currently connected to a mailserver
  *
- * Only if the mailer is noch connected sendingAllMails() can be started.
+ * Only if the mailer is noch connected sendingAllMails() can be started. A
+ * session kept alive without sending doesn't count as busy.
  *
  * @return if mailer ist busy
  */
 bool Mailer::isBusy()
 {
-    if (currentState == Disconnected) return false;
+    if (currentState == Disconnected || currentState == Idle) return false;
     return true;
 }
 
 
 /**
  * Returns after when the mailer ist not busy anymore.
+ *
+ * Sleeps in an event loop until finishedSending() is emitted.
  */
 void Mailer::waitForProcessing()
 {
+    if (!isBusy()) return;
     QEventLoop loop;
-    while (isBusy()){
-        loop.processEvents();
+    connect(this, SIGNAL(finishedSending(bool)), &loop, SLOT(quit()));
+    loop.exec();
+}
+
+
+/**
+ * Sends all mails of the mailqueue and returns when they are processed
+ *
+ * The calling thread sleeps in an event loop until finishedSending() is
+ * emitted or the deadline passes. In the latter case the connection is
+ * closed and the mails not processed yet stay in the mailqueue. The Mailer
+ * has to live in the calling thread.
+ *
+ * @param timeoutMs deadline for sending all mails in milliseconds
+ * @return result for every mail in the order they were processed, mails not
+ *         tried at all come last; empty if the mailer was busy
+ */
+QList<Mailer::MailResult> Mailer::sendAllMailsAndWait(int timeoutMs)
+{
+    if (isBusy()) return QList<MailResult>();
+    drainIngress();
+    int mailsQueued = mailqueue.size();
+    results.clear();
+
+    if (sendAllMails() && isBusy()){
+        QEventLoop  loop;
+        QTimer      deadline;
+        deadline.setSingleShot(true);
+        connect(this,       SIGNAL(finishedSending(bool)),  &loop, SLOT(quit()));
+        connect(&deadline,  SIGNAL(timeout()),              &loop, SLOT(quit()));
+        deadline.start(timeoutMs);
+        loop.exec();
+        if (isBusy()) disconnectFromServer();
+    }
+
+    // the mails not processed are still at the front of the mailqueue
+    QList<MailResult> summary = results;
+    for (int i{0}; results.size() + i < mailsQueued && i < int(mailqueue.size()); i++){
+        MailResult result;
+        result.recepients = mailqueue.at(i).getEnvelopeRecepients();
+        summary.append(result);
     }
+    return summary;
+}
+
+
+/**
+ * Returns the results of the mails processed by the last sendAllMails()
+ * @return result for every mail processed in that order
+ */
+QList<Mailer::MailResult> Mailer::lastResults() const
+{
+    return results;
 }
 
 
 /**
- * Connects to the currently set mailserver
+ * Starts to connect to the currently set mailserver
  *
- * can only be invokes if the mailer isn't busy at the moment.
+ * can only be invokes if the mailer isn't busy at the moment. The addresses
+ * of the server are taken from the HostCache. If they have expired they are
+ * looked up again, if a lookup is still running it is waited for. The TCP-
+ * and TLS-handshakes run in the background, connectionEstablished() and
+ * connectionEncrypted() are called when they are done. If they fail or take
+ * longer than smtpTimeout the next address is tried, after the last one
+ * handshakeTimedOut() or errorReceived() close the connection.
  *
- * @return true if the connection is established
+ * @return true if connecting has been started
  */
 bool Mailer::connectToServer()
 {
     if (currentState != Disconnected) return false;
-    tempErrors      = 0;
-    permErrors      = 0;
+    replyParser.clear();
+
+    currentState = Connecting;
+    commandWriter.clear();
+    handshakeTimer->start(smtpTimeout);
+    addressesTried      = 0;
+    tlsSessionPending   = false;
+    resolveServer();
+    if (serverLookup){
+        connectWhenResolved = true;
+        return true;
+    }
+    serverAddresses = HostCache::addresses(server);
+    connectSocket();
+    return true;
+}
 
+
+/**
+ * Connects the socket to the next address of the server, or to the
+ * servername if there is none. The certificate is checked against the
+ * servername in any case.
+ *
+ * Encrypted connections use the configuration of the TlsSessionCache, so
+ * the TLS session of the last connection to the server is offered again.
+ */
+void Mailer::connectSocket()
+{
+    QString host = addressesTried < serverAddresses.size() ?
+                   serverAddresses.at(addressesTried).toString() : server;
+    if (encryptionUsed != UNENCRYPTED){
+        QSslConfiguration configuration = TlsSessionCache::configuration(server, smtpPort);
+        offeredTlsSession = configuration.sessionTicket();
+        socket->setSslConfiguration(configuration);
+    }
     switch (encryptionUsed){
         case SSL :
-                    socket->connectToHostEncrypted(server, smtpPort);
-                    if (!socket->waitForEncrypted(smtpTimeout)){
-                        emit errorSendingMails(1, ERROR_ENCCONNECTIONNOTPOSSIBLE);
-                        return false;
-                    }
+                    socket->connectToHostEncrypted(host, smtpPort, server);
                     break;
         case STARTTLS    :
         case UNENCRYPTED :
-                    socket->connectToHost(server, smtpPort);
-                    if (!socket->waitForConnected(smtpTimeout)){
-                        emit errorSendingMails(0, ERROR_UNENCCONNECTIONNOTPOSSIBLE);
-                        return false;
-                    }
+                    socket->setPeerVerifyName(server);
+                    socket->connectToHost(host, smtpPort);
                     break;
         }
-    socketStream.setDevice(socket);
-    currentState = Connected;
+}
+
+
+/**
+ * Gives up the address which failed to connect and connects to the next
+ * address the connect started with, while the handshake is still running.
+ * @return false if there is no other address to try
+ */
+bool Mailer::connectNextAddress()
+{
+    if (currentState != Connecting) return false;
+    if (addressesTried + 1 >= serverAddresses.size()) return false;
+    addressesTried++;
+    socket->abort();
+    handshakeTimer->start(smtpTimeout);
+    connectSocket();
     return true;
 }
 
 
+/**
+ * Starts to look up the addresses of the server in the background, unless
+ * they are cached already or the server is given as an address. Mailers
+ * asking for the same server at the same time share one lookup.
+ */
+void Mailer::resolveServer()
+{
+    if (serverLookup || server.isEmpty())           return;
+    if (!QHostAddress(server).isNull())             return;
+    if (!HostCache::addresses(server).isEmpty())    return;
+
+    serverLookup = true;
+    HostCache::lookup(server, this, SLOT(serverResolved(QString)));
+}
+
+
+/**
+ * Called when the lookup of the server addresses is finished and they are
+ * cached. Connects if sendAllMails() was waiting for them.
+ * @param host  the hostname looked up
+ */
+void Mailer::serverResolved(const QString& host)
+{
+    if (!serverLookup || host.compare(server, Qt::CaseInsensitive) != 0) return;
+    serverLookup = false;
+
+    if (connectWhenResolved && currentState == Connecting){
+        connectWhenResolved = false;
+        serverAddresses = HostCache::addresses(server);
+        connectSocket();
+    }
+}
+
+
+/**
+ * Called when the TCP-connection is established. With SSL the session
+ * starts after the TLS-handshake in connectionEncrypted().
+ */
+void Mailer::connectionEstablished()
+{
+    if (currentState != Connecting || encryptionUsed == SSL) return;
+    handshakeTimer->stop();
+    currentState = Connected;
+}
+
+
+/**
+ * Called when the TLS-handshake is finished, after connecting with SSL or
+ * after STARTTLS.
+ */
+void Mailer::connectionEncrypted()
+{
+    handshakeTimer->stop();
+    TlsSessionCache::handshakeFinished(server, smtpPort, offeredTlsSession,
+                                       socket->sslConfiguration());
+    tlsSessionPending = true;
+    if (currentState == Connecting) currentState = Connected;
+}
+
+
+/**
+ * Called when the server sent a new TLS session after the handshake (TLS 1.3)
+ */
+void Mailer::tlsSessionReceived()
+{
+    TlsSessionCache::sessionNegotiated(server, smtpPort, socket->sslConfiguration());
+}
+
+
+/**
+ * Called when the TCP- or TLS-handshake didn't finish within smtpTimeout.
+ * Tries the next address of the server, after the last one closes the
+ * connection and emits errorSendingMails() with 0 if the server wasn't
+ * reached and 1 if the encryption failed.
+ */
+void Mailer::handshakeTimedOut()
+{
+    if (currentState == Disconnected) return;
+    if (connectNextAddress()) return;
+    bool encrypting = (encryptionUsed == SSL ||
+                       socket->state() == QAbstractSocket::ConnectedState);
+    socket->abort();
+    disconnectFromServer();
+    if (encrypting) emit errorSendingMails(1, ERROR_ENCCONNECTIONNOTPOSSIBLE);
+    else            emit errorSendingMails(0, ERROR_UNENCCONNECTIONNOTPOSSIBLE);
+}
+
+
 /**
  * Disconnects from the server and emits finishedSending()
  */
 void Mailer::disconnectFromServer()
 {
     if (currentState == Disconnected) return;
+    handshakeTimer->stop();
+    keepAliveTimer->stop();
+    idleTimer->stop();
+    sessionReused       = false;
+    connectWhenResolved = false;
+    abortMessagecontent();
     socket->disconnectFromHost();
     mailsProcessed  =   0;
     mailsToSend     =   0;
@@ -244,38 +585,98 @@ void Mailer::disconnectFromServer()
 }
 
 
+/**
+ * Opens a new session for the mails of the current sendAllMails() after the
+ * server closed the session kept alive, without emitting finishedSending()
+ */
+void Mailer::reconnect()
+{
+    handshakeTimer->stop();
+    abortMessagecontent();
+    socket->abort();
+    sessionReused   =   false;
+    recepientsSent  =   0;
+    loginState      =   PRELOGIN;
+    startTLSstate   =   preSTARTTLS;
+    capabilities    =   SmtpCapabilities();
+    currentState    =   Disconnected;
+    connectToServer();
+}
+
+
+/**
+ * Keeps the session open after all mails are processed instead of sending
+ * QUIT. Emits finishedSending() like disconnectFromServer() does and sends
+ * the mails enqueued in the meantime.
+ */
+void Mailer::sessionIdle()
+{
+    mailsProcessed  =   0;
+    mailsToSend     =   0;
+    recepientsSent  =   0;
+    sessionReused   =   false;
+    currentState    =   Idle;
+    keepAliveTimer->start(keepAliveInterval);
+    if (idleTimeout > 0) idleTimer->start(idleTimeout);
+    emit finishedSending( mailqueue.size() == 0 ? true : false);
+    if (mailsWaiting)
+        QMetaObject::invokeMethod(this, "sendWaitingMails", Qt::QueuedConnection);
+}
+
+
+/**
+ * Closes a session kept alive without emitting anything, the server has
+ * closed it or it isn't needed anymore.
+ * @param quit  true to send QUIT before
+ */
+void Mailer::closeIdleSession(bool quit)
+{
+    if (currentState != Idle && currentState != NOOPsent) return;
+    if (quit) sendQUIT();
+    keepAliveTimer->stop();
+    idleTimer->stop();
+    socket->disconnectFromHost();
+    loginState      =   PRELOGIN;
+    startTLSstate   =   preSTARTTLS;
+    currentState    =   Disconnected;
+}
+
+
+/**
+ * Called when the session kept alive was idle for the idle timeout
+ */
+void Mailer::idleTimedOut()
+{
+    closeIdleSession(true);
+}
+
+
 /**
  * Sends authorisation information to the server and starts to send the mail using sendMAILFROM()
  */
 void Mailer::sendAUTHLOGIN()
 {
     currentState = AUTH;
-    QString sendstring;
     switch (loginState){
         case PRELOGIN       :
-                                sendstring = "AUTH LOGIN\r\n";
+                                commandWriter.append("AUTH LOGIN\r\n");
                                 loginState = AUTHLOGINsent;
                                 break;
         case AUTHLOGINsent       :
-                                sendstring = username.toLocal8Bit().toBase64()+"\r\n";
+                                commandWriter.append(username.toLocal8Bit().toBase64()).append("\r\n");
                                 loginState = USERNAMEsent;
                                 break;
         case USERNAMEsent   :
-                                sendstring = password.toLocal8Bit().toBase64()+"\r\n";
+                                commandWriter.append(password.toLocal8Bit().toBase64()).append("\r\n");
                                 loginState = PASSWORDsent;
                                 break;
         case PASSWORDsent   :
                                 sendMAILFROM();
                                 loginState = PRELOGIN;
-                                break;
+                                return;
 
     }
-
-#ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);;
-#endif
-    socketStream << sendstring;
-    socketStream.flush();
+    flushCommands();
 }
 
 
@@ -284,12 +685,8 @@ void Mailer::sendAUTHLOGIN()
  */
 void Mailer::sendSTARTTLS()
 {
-    QString sendstring = "STARTTLS\r\n";
-#ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);;
-#endif
-    socketStream << sendstring;
-    socketStream.flush();
+    commandWriter.append("STARTTLS\r\n");
+    flushCommands();
     currentState = Connected;
     startTLSstate = postSTARTTLS;
 }
@@ -300,12 +697,10 @@ void Mailer::sendSTARTTLS()
  */
 void Mailer::sendEHLO()
 {
-    QString sendstring = "EHLO " + QHostInfo::localHostName() + "\r\n";
-#ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);;
-#endif
-    socketStream << sendstring;
-    socketStream.flush();
+    commandWriter.append("EHLO ").append(HostCache::localHostName()).append("\r\n");
+    flushCommands();
+    // capabilities have to be announced again (e.g. after STARTTLS)
+    capabilities = SmtpCapabilities();
     currentState = EHLOsent;
 }
 
@@ -315,36 +710,41 @@ void Mailer::sendEHLO()
  */
 void Mailer::sendMAILFROM()
 {
-    QString sendstring = "MAIL FROM:<" +
-                         pureMailaddressFromAddressstring(mailqueue.front().getSender()) +
-                         ">\r\n";
-#ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);;
-#endif
-    socketStream << sendstring;
-    socketStream.flush();
+    // mails larger than the server accepts are rejected before anything is sent
+    while (!mailqueue.empty() && mailsProcessed < mailsToSend){
+        startTransaction();
+        qint64 sizeLimit = capabilities.sizeLimit();
+        if (sizeLimit == 0 || messageSize <= sizeLimit) break;
+        permErrors++;
+        emit errorSendingMails(552, ERROR_MAILTOOLARGE);
+        mailProcessed(false, 552, ERROR_MAILTOOLARGE);
+    }
+    if (mailqueue.empty()) mailsToSend = mailsProcessed;
+    if (mailsProcessed >= mailsToSend){
+        sendNextMailOrQuit();
+        return;
+    }
+
+    if (pipeliningUsed && capabilities.has("PIPELINING")){
+        sendPipelinedTransaction();
+        return;
+    }
+    appendMAILFROM();
+    flushCommands();
     currentState = MAILFROMsent;
 }
 
 
 /**
- * Sends RCPT TO: to the SMTP-server
+ * Sends RCPT TO: for the next recepient to the SMTP-server
  */
 void Mailer::sendTO()
 {
-    QString sendstring = "RCPT TO:<" +
-                         pureMailaddressFromAddressstring(mailqueue.front().getAllRecepients().
-                                                          at(recepientsSent++)) +
-                         ">\r\n";
-#ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);;
-#endif
-    socketStream << sendstring;
-    socketStream.flush();
-    if (recepientsSent == mailqueue.front().getAllRecepients().size()) {
-        recepientsSent = 0;
-        currentState = TOsent;
-    }
+    commandWriter.append("RCPT TO:<")
+                 .append(pureMailaddressFromAddressstring(envelope.at(recepientsSent++)))
+                 .append(">\r\n");
+    flushCommands();
+    currentState = TOsent;
 }
 
 
@@ -353,28 +753,86 @@ void Mailer::sendTO()
  */
 void Mailer::sendDATA()
 {
-    QString sendstring = "DATA\r\n";
-#ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);;
-#endif
-    socketStream << sendstring;
-    socketStream.flush();
+    commandWriter.append("DATA\r\n");
+    flushCommands();
     currentState = DATAsent;
 }
 
 
 /**
- * Sends the messagecontent to the SMTP-server
+ * Starts sending the messagecontent to the SMTP-server
+ *
+ * The content is written chunk by chunk by writeMessagecontent() whenever
+ * the socket has written the previous data.
  */
 void Mailer::sendMessagecontent()
 {
-    QString sendstring = mailqueue.front().plaintextMail();
+    abortMessagecontent();
+    contentStream = new MailStream(mailqueue.front(), MailStream::DATA_TRANSFER, this);
+    contentStream->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    contentBytesSent    = 0;
+    contentBytesTotal   = contentStream->totalSize();
 #ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);;
+    qDebug() << "Sending: " << contentBytesTotal << " bytes of messagecontent";
 #endif
-    socketStream << sendstring;
-    socketStream.flush();
     currentState = CONTENTsent;
+    writeMessagecontent();
+}
+
+
+/**
+ * Sends the next chunk of the messagecontent with BDAT to the SMTP-server (rfc3030)
+ *
+ * Attachments are sent unencoded and nothing is dot-stuffed. Each chunk
+ * is sent after the server acknowledged the previous one, so at most
+ * BDATCHUNKSIZE bytes of the mail are held in memory.
+ */
+void Mailer::sendBDAT()
+{
+    if (!contentStream){
+        contentStream = new MailStream(mailqueue.front(), MailStream::BDAT_TRANSFER, this);
+        contentStream->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        contentBytesSent    = 0;
+        contentBytesTotal   = contentStream->totalSize();
+    }
+    QByteArray chunk = contentStream->read(BDATCHUNKSIZE);
+    lastBDATsent = contentStream->atEnd();
+    commandWriter.append("BDAT ").appendNumber(chunk.size())
+                 .append(lastBDATsent ? " LAST\r\n" : "\r\n");
+    flushCommands();
+    socket->write(chunk);
+    if (lastBDATsent) abortMessagecontent();
+    currentState = BDATsent;
+}
+
+
+/**
+ * Writes the next chunks of the messagecontent to the socket until
+ * CONTENTWRITEBUFFER bytes are waiting to be sent or the mail is complete.
+ */
+void Mailer::writeMessagecontent()
+{
+    char chunk[CONTENTCHUNKSIZE];
+    while (contentStream && socket->bytesToWrite() < CONTENTWRITEBUFFER){
+        qint64 length = contentStream->read(chunk, CONTENTCHUNKSIZE);
+        if (length <= 0){
+            abortMessagecontent();
+            break;
+        }
+        socket->write(chunk, length);
+    }
+}
+
+
+/**
+ * Stops reading the messagecontent, e.g. if the server closed the transaction
+ */
+void Mailer::abortMessagecontent()
+{
+    if (!contentStream) return;
+    contentStream->close();
+    contentStream->deleteLater();
+    contentStream = nullptr;
 }
 
 
@@ -383,13 +841,35 @@ void Mailer::sendMessagecontent()
  */
 void Mailer::sendQUIT()
 {
-    QString sendstring = "QUIT\r\n";
+    commandWriter.append("QUIT\r\n");
+    flushCommands();
+    currentState = QUITsent;
+}
+
+
+/**
+ * Sends NOOP to keep the idle session alive
+ */
+void Mailer::sendNOOP()
+{
+    if (currentState != Idle) return;
+    commandWriter.append("NOOP\r\n");
+    flushCommands();
+    currentState = NOOPsent;
+}
+
+
+/**
+ * Writes the commands collected in commandWriter to the server, once per
+ * protocol turn
+ */
+void Mailer::flushCommands()
+{
 #ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);
+    QByteArray commands = commandWriter.pending();
+    qDebug() << "Sending: " << commands.left(commands.size()-2);
 #endif
-    socketStream << sendstring;
-    socketStream.flush();
-    currentState = QUITsent;
+    commandWriter.flush();
 }
 
 
@@ -398,98 +878,440 @@ void Mailer::sendQUIT()
  */
 void Mailer::sendRSET()
 {
-    QString sendstring = "RSET\r\n";
-#ifdef DEBUG
-    qDebug() << "Sending: " << sendstring.left(sendstring.size()-2);
-#endif
-    socketStream << sendstring;
-    socketStream.flush();
+    commandWriter.append("RSET\r\n");
+    flushCommands();
     currentState = RSETsent;
 }
 
 
 /**
- * Invokes sendQUIT() to QUIT the session if all mails in the queue are processed once.
+ * Sends MAIL FROM:, all RCPT TO: and DATA in one batch to the SMTP-server (rfc2920)
+ *
+ * The replies are matched to the commands in the order they were sent by
+ * pipelinedReplyReceived().
+ */
+void Mailer::sendPipelinedTransaction()
+{
+    pipelinedCommands.clear();
+    pipelinedErrorCode              =   0;
+    pipelinedErrorText.clear();
+
+    appendMAILFROM();
+    pipelinedCommands.push_back(PIPELINED_MAILFROM);
+    foreach (const QString& recepient, envelope){
+        commandWriter.append("RCPT TO:<")
+                     .append(pureMailaddressFromAddressstring(recepient))
+                     .append(">\r\n");
+        pipelinedCommands.push_back(PIPELINED_RCPTTO);
+    }
+    // BDAT follows when the replies to RCPT TO are in, see pipelinedReplyReceived()
+    if (!bdatTransfer){
+        commandWriter.append("DATA\r\n");
+        pipelinedCommands.push_back(PIPELINED_DATA);
+    }
+    // the whole transaction goes out with one write
+    flushCommands();
+    currentState = PIPELINEsent;
+}
+
+
+/**
+ * Invokes sendQUIT() to QUIT the session if all mails in the queue are processed once,
+ * or keeps it alive with sessionIdle() if useKeepAlive() is set.
  * If not all mails are processed sendEHLO() starts the sending process for
  * next mail.
+ *
+ * Before quitting readyForMoreMails() is emitted, so a MailerPool can hand
+ * over the next mail to send on this connection.
  */
 void Mailer::sendNextMailOrQuit()
 {
+    if (mailsProcessed >= mailsToSend)
+        emit readyForMoreMails();
     if (mailsProcessed >= mailsToSend){
-        sendQUIT();
+        if (keepAliveUsed)  sessionIdle();
+        else                sendQUIT();
     } else {
         sendMAILFROM();
     }
 }
 
 
+/**
+ * Finishes the current transaction for all mails sharing it, see
+ * mailOfBatchProcessed(). A mail of a coalesced transaction counts as
+ * delivered only if at least one of its own recepients was accepted.
+ *
+ * @param delivered true if the server accepted the mail
+ * @param replyCode last reply of the server for the mail
+ * @param replyText text of that reply
+ */
+void Mailer::mailProcessed(bool delivered, int replyCode, const QString &replyText)
+{
+    if (batchSizes.isEmpty()) batchSizes.append(envelope.size());
+    int offset{0};
+    foreach (int size, batchSizes){
+        QList<RecepientResult> mailResults = recepientResults.mid(offset, size);
+        bool    mailDelivered   = delivered;
+        int     mailReplyCode   = replyCode;
+        QString mailReplyText   = replyText;
+        if (delivered && batchSizes.size() > 1 && recepientsAccepted(mailResults) == 0){
+            mailDelivered = false;
+            mailReplyCode = recepientsErrorCode(mailResults);
+            mailReplyText.clear();
+        }
+        mailOfBatchProcessed(mailDelivered, mailReplyCode, mailReplyText,
+                             envelope.mid(offset, size), mailResults);
+        offset += size;
+    }
+    recepientResults.clear();
+    batchSizes.clear();
+}
+
+
 /**
  * Pops the first element from the mailqueue and emits mailsHaveBeenProcessedTillNow()
  * and increments mailsProcesses by 1
+ *
+ * Recepients which got a temporary error are tried again later with
+ * retryLater(), those with a permanent error are dropped:
+ * - delivered: a copy of the mail goes only to the recepients with temporary errors
+ * - temporary error: the mail is tried again without the recepients having
+ *   permanent errors, as it is if there are none
+ * - permanent error: nobody gets the mail
+ *
+ * @param delivered         true if the server accepted the mail
+ * @param replyCode         last reply of the server for the mail
+ * @param replyText         text of that reply
+ * @param envelope          recepients of the mail in the transaction
+ * @param recepientResults  replies to RCPT TO: for these recepients
  */
-void Mailer::mailProcessed()
+void Mailer::mailOfBatchProcessed(bool delivered, int replyCode, const QString &replyText,
+                                  const QStringList &envelope,
+                                  const QList<RecepientResult> &recepientResults)
 {
     if (mailqueue.size() > 0){
+        const Mail& mail = mailqueue.front();
+        QStringList retry;
+        bool        retryAll{!delivered && replyCode < 500};
+        foreach (const RecepientResult& recepient, recepientResults){
+            if (recepient.accepted && !delivered && replyCode < 500)
+                retry.append(recepient.address);
+            if (!recepient.accepted && recepient.replyCode < 500 && (delivered || replyCode < 500))
+                retry.append(recepient.address);
+            if (!recepient.accepted && recepient.replyCode >= 500)
+                retryAll = false;
+        }
+        // recepients not asked yet, e.g. if MAIL FROM: failed
+        if (!delivered && replyCode < 500){
+            for (int i{recepientResults.size()}; i < envelope.size(); i++)
+                retry.append(envelope.at(i));
+        }
+
+        if (retryAll){
+            // the same mail is tried again, it stays pending in the spool
+            retryLater(mail);
+        } else {
+            if (!retry.isEmpty()){
+                Mail split(mail);
+                split.setEnvelopeRecepients(retry);
+                if (spool) spool->store(split);
+                retryLater(split);
+            }
+            if (spool) spool->markFinished(mail);
+        }
+        if (retryScheduler && delivered) retryScheduler->delivered(mail, server);
+
+        MailResult result;
+        result.recepients       = mail.getEnvelopeRecepients();
+        result.delivered        = delivered;
+        result.replyCode        = replyCode;
+        result.replyText        = replyText;
+        result.recepientResults = recepientResults;
+        results.append(result);
         mailqueue.pop_front();
+        queuedMails--;
         mailsProcessed++;
         emit mailsHaveBeenProcessedTillNow(mailsProcessed);
     }
 }
 
 
+/**
+ * Reorders the mailqueue so mails with the same content and sender follow
+ * each other and can share a transaction. Otherwise the order is kept.
+ */
+void Mailer::groupIdenticalMails()
+{
+    QVector<QVector<int> >      groups;
+    QHash<uint, QVector<int> >  groupsByHash;
+    for (int i{0}; i < int(mailqueue.size()); i++){
+        uint    hash = mailqueue[i].contentHash();
+        int     group{-1};
+        foreach (int candidate, groupsByHash.value(hash)){
+            if (mailqueue[groups.at(candidate).first()].hasSameContent(mailqueue[i])){
+                group = candidate;
+                break;
+            }
+        }
+        if (group < 0){
+            group = groups.size();
+            groups.append(QVector<int>());
+            groupsByHash[hash].append(group);
+        }
+        groups[group].append(i);
+    }
+    if (groups.size() == int(mailqueue.size())) return;
+
+    std::deque<Mail> grouped;
+    foreach (const QVector<int>& group, groups){
+        foreach (int i, group) grouped.push_back(mailqueue[i]);
+    }
+    mailqueue.swap(grouped);
+}
+
+
+/**
+ * Returns the number of recepients a transaction may have: the configured
+ * maximum or the limit learned from the server, if it is lower.
+ */
+int Mailer::recepientLimit() const
+{
+    if (serverRecepientLimit > 0) return qMin(maxRecepients, serverRecepientLimit);
+    return maxRecepients;
+}
+
+
+/**
+ * Puts a mail back for a later try, to the RetryScheduler if there is one
+ * or to the back of the mailqueue.
+ * @param mail  the mail to try again
+ */
+void Mailer::retryLater(const Mail &mail)
+{
+    if (retryScheduler){
+        retryScheduler->defer(mail, this);
+        return;
+    }
+    mailqueue.push_back(mail);
+    queuedMails++;
+}
+
+
+/**
+ * Prepares the transaction for the first mail of the mailqueue. When
+ * coalescing, the following mails with the same content are added to the
+ * envelope up to the recepient limit.
+ */
+void Mailer::startTransaction()
+{
+    bdatTransfer    = chunkingUsed && capabilities.has("CHUNKING") &&
+                      capabilities.has("BINARYMIME");
+    envelope        = mailqueue.front().getEnvelopeRecepients();
+    recepientsSent  = 0;
+    recepientResults.clear();
+    batchSizes.clear();
+    batchSizes.append(envelope.size());
+    // the mails of a coalesced transaction have the same content, so this is the size of all
+    messageSize     = capabilities.has("SIZE") ? qMax<qint64>(0, mailqueue.front().size(bdatTransfer)) : 0;
+    if (!coalescingUsed) return;
+
+    // following mails with the same content share the transaction
+    const Mail& first = mailqueue.front();
+    for (int i{1}; i < int(mailqueue.size()) && mailsProcessed + i < mailsToSend; i++){
+        const Mail& next = mailqueue[i];
+        if (!first.hasSameContent(next)) break;
+        QStringList recepients = next.getEnvelopeRecepients();
+        if (envelope.size() + recepients.size() > recepientLimit()) break;
+        envelope.append(recepients);
+        batchSizes.append(recepients.size());
+    }
+}
+
+
+/**
+ * Appends the MAIL FROM: command for the current transaction to the
+ * commands to send, declaring the size (rfc1870) and the binary body
+ * (rfc3030) if used
+ */
+void Mailer::appendMAILFROM()
+{
+    commandWriter.append("MAIL FROM:<")
+                 .append(pureMailaddressFromAddressstring(mailqueue.front().getSender()))
+                 .append(">");
+    if (bdatTransfer)       commandWriter.append(MAILFROM_BINARYMIME);
+    if (messageSize > 0)    commandWriter.append(" SIZE=").appendNumber(messageSize);
+    commandWriter.append("\r\n");
+}
+
+
+/**
+ * Records the reply of the server to RCPT TO: for the next recepient of the
+ * envelope. A rejected recepient is reported with errorSendingMails().
+ * @param replyCode three digit SMTP reply code
+ * @param replyText the last line of the reply
+ */
+void Mailer::recepientReplyReceived(int replyCode, const QString &replyText)
+{
+    RecepientResult result;
+    result.address      = envelope.value(recepientResults.size());
+    result.accepted     = (replyCode >= 200 && replyCode < 300);
+    result.replyCode    = replyCode;
+    result.replyText    = replyText;
+    recepientResults.append(result);
+    if (!result.accepted) emit errorSendingMails(replyCode, replyText);
+
+    // 452 is the reply for too many recepients (rfc5321 4.5.3.1.10)
+    int accepted = recepientsAccepted(recepientResults);
+    if (replyCode == 452 && accepted > 0 &&
+            (serverRecepientLimit == 0 || accepted < serverRecepientLimit))
+        serverRecepientLimit = accepted;
+}
+
+
+/**
+ * Returns the number of recepients accepted by the server
+ * @param recepients    results of the recepients
+ */
+int Mailer::recepientsAccepted(const QList<RecepientResult> &recepients) const
+{
+    int accepted{0};
+    foreach (const RecepientResult& recepient, recepients)
+        if (recepient.accepted) accepted++;
+    return accepted;
+}
+
+
+/**
+ * Returns the error to report if no recepient was accepted: a temporary one
+ * if there is any, because it is worth to try the mail again.
+ * @param recepients    results of the recepients
+ * @return reply code, 0 if there was no error
+ */
+int Mailer::recepientsErrorCode(const QList<RecepientResult> &recepients) const
+{
+    int errorCode{0};
+    foreach (const RecepientResult& recepient, recepients){
+        if (recepient.accepted) continue;
+        if (errorCode == 0 || recepient.replyCode < 500) errorCode = recepient.replyCode;
+    }
+    return errorCode;
+}
+
+
 /**
  * Is called every time when there is new data ready to read on the tcp-socket
  *
+ * The SmtpReplyParser collects the lines of (multiline) replies and every
+ * complete reply is handed to replyReceived(). Several replies can arrive at
+ * once when pipelining.
+ *
  * Is called by connect from socket::readyRead()
  */
 void Mailer::dataReadyForReading()
 {
-    QString replyCode;
-    while(socket->canReadLine()){   // for multiline replys
-        replyCode = socketStream.readLine();
+    qint64 bytesRead;
+    do {
+        bytesRead = replyParser.readFrom(socket);
+        while (replyParser.nextReply()) replyReceived();
+    } while (bytesRead > 0 && socket->bytesAvailable() > 0);
+}
+
+
+/**
+ * Handles the complete reply of the SMTP-server in replyParser and sends the
+ * next command
+ */
+void Mailer::replyReceived()
+{
 #ifdef DEBUG
-    qDebug() << "Received: " << replyCode;
+    qDebug() << "Received: " << replyParser.text();
 #endif
+    int replyCode = replyParser.code();
+    if (replyCode == 0) return;
+    // e.g. the reply to the QUIT sent by closeIdleSession()
+    if (currentState == Disconnected) return;
+
+    // With TLS 1.3 the session arrives after the handshake, before the first reply
+    if (tlsSessionPending){
+        tlsSessionPending = false;
+        TlsSessionCache::sessionNegotiated(server, smtpPort, socket->sslConfiguration());
     }
-    replyCode.truncate(3);
 
-    switch (replyCode.at(0).toLatin1()){
-        case '5'    :   // Permanent error => The mail will be lost...
-                        permErrors++;
-                        emit errorSendingMails(replyCode.toInt(), socket->errorString());
-                        mailProcessed();
-                        qDebug() << "Permanent error: " <<  socket->errorString();
-                        sendRSET();
-                        return;
-                        break; // Just in case...
-        case '4'    :   // Transient error => The mail will be enqueued again
-                        tempErrors++;
-                        mailqueue.push_back(mailqueue.front());
-                        mailProcessed();
-                        sendRSET();
-                        emit errorSendingMails(replyCode.toInt(), socket->errorString());
-                        qDebug() << "Temporary error: " << socket->errorString();
+    // The server may have closed the session kept alive before our first command
+    bool firstReplyOfReusedSession = sessionReused;
+    sessionReused = false;
+    if (firstReplyOfReusedSession && replyCode == 421){
+        reconnect();
+        return;
+    }
+
+    if (currentState == Idle || currentState == NOOPsent){
+        if (currentState == NOOPsent && replyCode / 100 == 2){
+            currentState = Idle;
+            if (mailsWaiting)
+                QMetaObject::invokeMethod(this, "sendWaitingMails", Qt::QueuedConnection);
+        } else {
+            closeIdleSession();     // 421 or no reply to NOOP
+        }
+        return;
+    }
+
+    if (currentState == PIPELINEsent){
+        pipelinedReplyReceived(replyCode, replyParser.text());
+        return;
+    }
+
+    // A rejected recepient doesn't end the transaction while others are accepted
+    if (currentState == TOsent){
+        recepientReplyReceived(replyCode, replyParser.text());
+        if (recepientsSent < envelope.size()){
+            sendTO();
+        } else if (recepientsAccepted(recepientResults) == 0){
+            smtpErrorReceived(recepientsErrorCode(recepientResults), QString());
+        } else if (bdatTransfer){
+            sendBDAT();
+        } else {
+            sendDATA();
+        }
+        return;
+    }
+
+    switch (replyCode / 100){
+        case 5      :   // Permanent error => The mail will be lost...
+        case 4      :   // Transient error => The mail will be enqueued again
+                        smtpErrorReceived(replyCode, replyParser.text());
                         return;
                         break; // Just in case...
-        case '3'    :   // Positive intermediate reply => Wonderful nothing to do.
+        case 3      :   // Positive intermediate reply => Wonderful nothing to do.
                         break;
-        case '2'    :   // Positive completion reply => Wonderful nothing to do.
+        case 2      :   // Positive completion reply => Wonderful nothing to do.
                         break;
     }
 
     switch (currentState){
 
         case Disconnected   :
+        case Connecting     :
         case Connected      :
-                                if (startTLSstate == postSTARTTLS)
+                                if (startTLSstate == postSTARTTLS){
+                                    // nothing received unencrypted may be taken as a reply after STARTTLS
+                                    replyParser.clear();
+                                    handshakeTimer->start(smtpTimeout);
                                     socket->startClientEncryption();
+                                }
                                 sendEHLO();
                                 break;
         case EHLOsent       :
+                                capabilities = SmtpCapabilities(replyParser.lines());
+                                if (capabilities.recepientLimit() > 0)
+                                    serverRecepientLimit = capabilities.recepientLimit();
                                 if (encryptionUsed == STARTTLS && startTLSstate == preSTARTTLS){
                                     sendSTARTTLS();
                                     break;
                                 }
+                                // only the capabilities of the session used for sending count
+                                SmtpCapabilities::cache(server, smtpPort, capabilities);
                                 if (authMethodToUse == NO_Auth)
                                     sendMAILFROM();
                                 else if (authMethodToUse == LOGIN)
@@ -499,16 +1321,24 @@ void Mailer::dataReadyForReading()
                                 sendAUTHLOGIN();
                                 break;
         case MAILFROMsent   :
-                                sendTO();
+                                if (envelope.isEmpty()) smtpErrorReceived(554, QString());
+                                else                    sendTO();
                                 break;
-        case TOsent         :
-                                sendDATA();
+        case TOsent         :   // handled above
                                 break;
         case DATAsent       :
                                 sendMessagecontent();
                                 break;
         case CONTENTsent    :
-                                mailProcessed();
+                                mailProcessed(true, replyCode, replyParser.text());
+                                sendNextMailOrQuit();
+                                break;
+        case BDATsent       :
+                                if (!lastBDATsent){
+                                    sendBDAT();
+                                    break;
+                                }
+                                mailProcessed(true, replyCode, replyParser.text());
                                 sendNextMailOrQuit();
                                 break;
         case RSETsent       :
@@ -517,17 +1347,114 @@ void Mailer::dataReadyForReading()
         case QUITsent       :
                                 disconnectFromServer();
                                 break;
+        case PIPELINEsent   :
+        case Idle           :
+        case NOOPsent       :   // handled above
+                                break;
 
     }
 }
 
 
+/**
+ * Handles the replies to the commands sent by sendPipelinedTransaction()
+ *
+ * Replies arrive in the order the commands were sent. A rejected recipient
+ * is reported with errorSendingMails() but doesn't abort the transaction as
+ * long as the server accepted at least one other recipient.
+ *
+ * @param replyCode three digit SMTP reply code
+ * @param replyText the last line of the reply
+ */
+void Mailer::pipelinedReplyReceived(int replyCode, const QString &replyText)
+{
+    if (pipelinedCommands.empty()) return;
+    Pipelined_Command command = pipelinedCommands.front();
+    pipelinedCommands.pop_front();
+    bool positive = (replyCode >= 200 && replyCode < 400);
+
+    switch (command){
+        case PIPELINED_MAILFROM :
+                                if (!positive){
+                                    pipelinedErrorCode = replyCode;
+                                    pipelinedErrorText = replyText;
+                                }
+                                break;
+        case PIPELINED_RCPTTO   :
+                                if (pipelinedErrorCode != 0) break;  // MAIL FROM failed already
+                                recepientReplyReceived(replyCode, replyText);
+                                break;
+        case PIPELINED_DATA     :
+                                if (replyCode == 354){
+                                    if (pipelinedErrorCode == 0 && recepientsAccepted(recepientResults) > 0){
+                                        sendMessagecontent();
+                                        return;
+                                    }
+                                    // DATA was accepted without a recipient, so end the empty message
+                                    commandWriter.append(".\r\n");
+                                    flushCommands();
+                                    pipelinedCommands.push_back(PIPELINED_DOT);
+                                    return;
+                                }
+                                if (pipelinedErrorCode == 0 && recepientsAccepted(recepientResults) > 0){
+                                    pipelinedErrorCode = replyCode;
+                                    pipelinedErrorText = replyText;
+                                }
+                                break;
+        case PIPELINED_DOT      :
+                                break;
+    }
+    if (!pipelinedCommands.empty()) return;
+
+    if (bdatTransfer && pipelinedErrorCode == 0 && recepientsAccepted(recepientResults) > 0){
+        sendBDAT();
+        return;
+    }
+
+    // All replies are in and the message wasn't sent
+    if (pipelinedErrorCode == 0){
+        pipelinedErrorCode = recepientsErrorCode(recepientResults);
+        pipelinedErrorText.clear();   // already reported per recepient
+    }
+    if (pipelinedErrorCode < 400) pipelinedErrorCode = 554;
+    smtpErrorReceived(pipelinedErrorCode, pipelinedErrorText);
+}
+
+
+/**
+ * Handles a negative reply of the server for the mail currently processed.
+ *
+ * For temporary errors the mail is enqueued again, for permanent errors the
+ * mail is removed from the mailqueue. Afterwards the session is reset by
+ * sendRSET().
+ *
+ * @param replyCode three digit SMTP reply code (4xx or 5xx)
+ * @param errorText human readable errortext to emit, nothing is emitted if empty
+ */
+void Mailer::smtpErrorReceived(int replyCode, const QString &errorText)
+{
+    abortMessagecontent();
+    if (replyCode >= 500){
+        permErrors++;
+        if (!errorText.isEmpty()) emit errorSendingMails(replyCode, errorText);
+        mailProcessed(false, replyCode, errorText);
+        qDebug() << "Permanent error: " << errorText;
+    } else {
+        tempErrors++;
+        mailProcessed(false, replyCode, errorText);
+        if (!errorText.isEmpty()) emit errorSendingMails(replyCode, errorText);
+        qDebug() << "Temporary error: " << errorText;
+    }
+    sendRSET();
+}
+
+
 /**
  * @brief Mailer::errorReceived
  *
  * This method is called if there comes an error from the tcp-socket, in this
- * case we close the connection and emit errorSendingMails with the
- * fake-smtp-error code 0
+ * case we try the next address of the server while connecting, or close the
+ * connection and emit errorSendingMails with the fake-smtp-error code 0
  */
 void Mailer::errorReceived(QAbstractSocket::SocketError)
 {
@@ -535,6 +1462,17 @@ void Mailer::errorReceived(QAbstractSocket::SocketError)
     // which is not a real error due to the fact that the session is already closed
     if (currentState == Disconnected) return;
 
+    // The server closed the session kept alive, the next mails open a new one
+    if (currentState == Idle || currentState == NOOPsent){
+        closeIdleSession();
+        return;
+    }
+    if (sessionReused){
+        reconnect();
+        return;
+    }
+    if (connectNextAddress()) return;
+
     //closing the session should not overwrite our errorstring
     QString errorString = socket->errorString();
 
@@ -548,20 +1486,44 @@ void Mailer::errorReceived(QAbstractSocket::SocketError)
  *
  * This method is called if there are ssl-errors from the tcp-socket, in this
  * case we close the connection and emit errorSendingMails with the
- * fake-smtp-error code 1 (for ssl-errors)
+ * fake-smtp-error code 1 (for ssl-errors). A self signed certificate alone
+ * doesn't close the connection if ignoreSelfSignedCertificates() is set.
  */
 void Mailer::sslErrorsReceived(QList<QSslError> errors)
 {
+    bool fatal{false};
     foreach (QSslError error, errors){
         if (ignoreSelfSigned){
             QList<QSslError> liste;
             liste.append(QSslError(QSslError::SelfSignedCertificate, socket->peerCertificate()));
             socket->ignoreSslErrors(liste);
         }
-        if (!(ignoreSelfSigned && (error.error() == QSslError::SelfSignedCertificate)))
+        if (!(ignoreSelfSigned && (error.error() == QSslError::SelfSignedCertificate))){
             emit errorSendingMails(1, error.errorString());
+            fatal = true;
+        }
     }
-    disconnectFromServer();
+    if (fatal) disconnectFromServer();
+}
+
+
+/**
+ * Called when the socket has written data to the server. Emits
+ * mailBytesSentTillNow() and refills the socket while content is sent.
+ * @param bytes number of bytes written
+ */
+void Mailer::contentBytesWritten(qint64 bytes)
+{
+    if (currentState != CONTENTsent && currentState != BDATsent) return;
+    if (contentBytesTotal < 0){
+        contentBytesSent += bytes;
+        emit mailBytesSentTillNow(contentBytesSent, contentBytesTotal);
+    } else if (contentBytesSent < contentBytesTotal){
+        contentBytesSent = qMin(contentBytesSent + bytes, contentBytesTotal);
+        emit mailBytesSentTillNow(contentBytesSent, contentBytesTotal);
+    }
+    // the total is only used for the progress, the content ends when the stream does
+    if (currentState == CONTENTsent && contentStream) writeMessagecontent();
 }
 
 
@@ -672,50 +1634,148 @@ void Mailer::setEncryptionUsed(const ENCRYPTION &value)
  */
 QString Mailer::pureMailaddressFromAddressstring(const QString &addressstring)
 {
-    // if the string is a plain mailaddress return it as is
-    if (validPureMailaddress(addressstring))
-        return addressstring;
+    // a plain mailaddress or a string we can't parse is returned as is
+    return MailAddress::addressPart(addressstring).toString();
+}
 
-    // if we don't have a sane string return it as is.
-    if (!validDecoratedAddress(addressstring))
-        return addressstring;
 
-    // So we have an addressstring with decoration and <mailaddress>, then cut away anything including <>
-    QString returnValue = addressstring;
-    returnValue.remove(QRegExp(R"(^.*<)"));
-    returnValue.remove(QRegExp(R"(>\s*$)"));
-    return returnValue;
+/**
+ * Ignore self signed certificates
+ */
+void Mailer::ignoreSelfSignedCertificates(bool ignore)
+{
+    ignoreSelfSigned = ignore;
 }
 
 
 /**
- * Tests if a string contains a valid plain mailaddress as in "local@domain.tld".
- * @param address   the address to test.
- * @return true if address is a valid plain mailaddress
+ * Send MAIL FROM, all RCPT TO and DATA in one batch if the server offers
+ * PIPELINING in its EHLO reply (rfc2920). Enabled by default.
  */
-inline bool Mailer::validPureMailaddress(const QString &address)
+void Mailer::usePipelining(bool use)
 {
-    return address.contains(QRegExp(R"(^[A-Za-z0-9.!#$%&'*+-/=?^_`{|}~]+@[a-zA-Z0-9]+.[a-zA-Z]{2,4}$)"));
+    pipeliningUsed = use;
 }
 
 
 /**
- * Tests if a string contains a valid plain mailaddress as in "My Name <local@domain.tld>".
- * @param address   the address to test.
- * @return true if address is a valid decorated mailaddress
+ * Send the messagecontent with BDAT and unencoded attachments if the server
+ * offers CHUNKING and BINARYMIME in its EHLO reply (rfc3030). Enabled by default.
  */
-inline bool Mailer::validDecoratedAddress(const QString &address)
+void Mailer::useChunking(bool use)
 {
-    return address.contains(QRegExp(
-                                R"(^.*<[A-Za-z0-9.!#$%&'*+-/=?^_`{|}~]+@[a-zA-Z0-9]+.[a-zA-Z]{2,4}>\s*$)"
-                                ));
+    chunkingUsed = use;
 }
 
 
 /**
- * Ignore self signed certificates
+ * Sends mails with the same content and sender in one transaction with all
+ * their recepients. The mailqueue is grouped accordingly by sendAllMails().
+ * The results are reported for every mail as if it was sent alone.
+ * Disabled by default.
  */
-void Mailer::ignoreSelfSignedCertificates(bool ignore)
+void Mailer::useCoalescing(bool use)
 {
-    ignoreSelfSigned = ignore;
+    coalescingUsed = use;
+}
+
+
+/**
+ * Sets the number of recepients one coalesced transaction may have at most.
+ * A lower limit announced by the server (LIMITS RCPTMAX) or learned from a
+ * 452 reply is used instead.
+ * @param value maximum number of recepients, at least 1
+ */
+void Mailer::setMaxRecepientsPerTransaction(int value)
+{
+    if (value < 1) return;
+    maxRecepients = value;
+}
+
+
+/**
+ * The service extensions of the server, as announced in the EHLO reply of
+ * the current session or, if there is none, of the last session to this
+ * server and port.
+ * @return capabilities, empty if the server wasn't asked yet
+ */
+SmtpCapabilities Mailer::serverCapabilities() const
+{
+    if (!capabilities.isEmpty()) return capabilities;
+    return SmtpCapabilities::cached(server, smtpPort);
+}
+
+
+/**
+ * Keeps the session open when all mails are processed. Mails enqueued while
+ * the mailer isn't busy are sent right away, on the open session if the
+ * server hasn't closed it yet. Disabled by default.
+ */
+void Mailer::useKeepAlive(bool use)
+{
+    keepAliveUsed = use;
+    if (!use) closeIdleSession(true);
+}
+
+
+/**
+ * Sets the interval of NOOP commands keeping an idle session alive
+ * @param value interval in milliseconds
+ */
+void Mailer::setKeepAliveInterval(int value)
+{
+    if (value <= 0) return;
+    keepAliveInterval = value;
+}
+
+
+/**
+ * Sets the time after which an idle session is closed
+ * @param value timeout in milliseconds, 0 to keep it open until the server closes it
+ */
+void Mailer::setIdleTimeout(int value)
+{
+    if (value < 0) return;
+    idleTimeout = value;
+}
+
+
+/**
+ * Hands over mails with temporary errors to a RetryScheduler, which gives
+ * them back with enqueueMail() when their backoff has passed. Without a
+ * scheduler they are put to the back of the mailqueue at once.
+ * @param scheduler the scheduler to use, nullptr for none
+ */
+void Mailer::setRetryScheduler(RetryScheduler *scheduler)
+{
+    retryScheduler = scheduler;
+}
+
+
+/**
+ * Keeps the mailqueue in a MailSpool from now on. The mails still pending in
+ * the spool from an earlier run are put in front of the mailqueue, the mails
+ * already in the mailqueue are stored.
+ *
+ * The spool has to be open and to live in the thread of the mailer.
+ *
+ * @param spool the spool to use, nullptr to stop spooling
+ * @return false if the mailer is busy or the spool isn't open
+ */
+bool Mailer::setSpool(MailSpool *spool)
+{
+    if (isBusy()) return false;
+    if (spool && !spool->isOpen()) return false;
+    this->spool = spool;
+    if (!spool) return true;
+
+    drainIngress();
+    std::deque<Mail> queue;
+    queuedMails += spool->recoverInto(queue);
+    for (size_t i{0}; i < mailqueue.size(); i++){
+        spool->store(mailqueue[i]);
+        queue.push_back(mailqueue[i]);
+    }
+    mailqueue.swap(queue);
+    return true;
 }
@@ -31,30 +31,59 @@
 
 #include <QObject>
 #include <QList>
+#include <QVector>
+#include <QHash>
 #include <QString>
 #include <deque>
+#include <atomic>
 #include <QStringList>
 #include <utility>
 #include <QSslSocket>
 #include <QHostInfo>
 #include <QEventLoop>
+#include <QTimer>
 #include <QSslError>
 
 #include "mail.h"
+#include "mailaddress.h"
+#include "hostcache.h"
+#include "mailingress.h"
+#include "mailspool.h"
+#include "retryscheduler.h"
+#include "smtpcapabilities.h"
+#include "smtpcommandwriter.h"
+#include "smtpreplyparser.h"
+#include "tlssessioncache.h"
+#include "mailstream.h"
 
 #define SMTPPORT 25
 #define SMTPTIMEOUT 30000
+/// Messagecontent is only read from the MailStream while less than this is waiting in the socket
+#define CONTENTWRITEBUFFER 65536
+#define CONTENTCHUNKSIZE   16384
+/// Size of the chunks sent with BDAT (rfc3030)
+#define BDATCHUNKSIZE      1048576
+#define MAILFROM_BINARYMIME " BODY=BINARYMIME"
+/// Recepients of one transaction when coalescing mails, every server has to accept 100 (rfc5321)
+#define MAXRECEPIENTS      100
+/// NOOP interval of a session kept alive, servers wait at least 5 minutes for a command (rfc5321)
+#define KEEPALIVEINTERVAL  60000
+#define IDLETIMEOUT        300000
 
 #define ERROR_UNENCCONNECTIONNOTPOSSIBLE    "Could not connect to server"
 #define ERROR_ENCCONNECTIONNOTPOSSIBLE      "Could not connect to server encrypted"
+#define ERROR_MAILTOOLARGE                  "Mail is larger than the server accepts"
 
 class Mailer : public QObject
 {
     Q_OBJECT
 
+    friend class MailerPool;
+
     /// Defines the different states of the SMTP connection
     enum SMTP_States {
         Disconnected,
+        Connecting,
         Connected,
         EHLOsent,
         MAILFROMsent,
@@ -63,7 +92,11 @@ class Mailer : public QObject
         CONTENTsent,
         QUITsent,
         RSETsent,
-        AUTH
+        AUTH,
+        PIPELINEsent,
+        BDATsent,
+        Idle,
+        NOOPsent
     };
 
     /// Defines the different states of the SMTP-login
@@ -74,6 +107,14 @@ class Mailer : public QObject
         PASSWORDsent
     };
 
+    /// Defines the commands sent in one batch when the server offers PIPELINING (rfc2920)
+    enum Pipelined_Command {
+        PIPELINED_MAILFROM,
+        PIPELINED_RCPTTO,
+        PIPELINED_DATA,
+        PIPELINED_DOT
+    };
+
     /// Defines if the STARTTLS is already send to the server (when using STARTTLS)
     enum STARTTLSstate{
        preSTARTTLS,
@@ -94,6 +135,23 @@ public:
         NO_Auth
     };
 
+    /// Reply of the server to RCPT TO: for one recepient
+    struct RecepientResult {
+        QString     address;
+        bool        accepted{false};
+        int         replyCode{0};
+        QString     replyText;
+    };
+
+    /// Outcome of one mail of the last sendAllMails()
+    struct MailResult {
+        QStringList recepients;
+        bool        delivered{false};
+        int         replyCode{0};   ///< 0 if the mail wasn't tried
+        QString     replyText;
+        QList<RecepientResult> recepientResults;
+    };
+
     explicit Mailer(const QString &server, QObject *parent = 0);
 
     int                     sizeOfQueue() const;
@@ -103,6 +161,8 @@ public:
     void                    setServer(const QString &value);
     bool                    isBusy();
     void                    waitForProcessing();
+    QList<MailResult>       sendAllMailsAndWait(int timeoutMs);
+    QList<MailResult>       lastResults() const;
     std::pair<int,int>      lastErrors() const;
     int                     getSmtpPort() const;
     void                    setSmtpPort(int value);
@@ -113,16 +173,38 @@ public:
     void                    setUsername(const QString &value);
     void                    setEncryptionUsed(const ENCRYPTION &value);
     void					ignoreSelfSignedCertificates(bool ignore = true);
+    void                    usePipelining(bool use = true);
+    void                    useChunking(bool use = true);
+    bool                    setSpool(MailSpool* spool);
+    void                    setRetryScheduler(RetryScheduler* scheduler);
+    void                    useCoalescing(bool use = true);
+    void                    setMaxRecepientsPerTransaction(int value);
+    SmtpCapabilities        serverCapabilities() const;
+    void                    useKeepAlive(bool use = true);
+    void                    setKeepAliveInterval(int value);
+    void                    setIdleTimeout(int value);
 
 protected:
     QString             server;
     QSslSocket*         socket{nullptr};
-    QTextStream         socketStream;
+    SmtpCommandWriter   commandWriter;
     bool                isConnected{false};
     SMTP_States         currentState{Disconnected};
     std::deque<Mail>    mailqueue;
+    MailIngress         ingress;
+    std::atomic<int>    ingressCount{0};
+    std::atomic<int>    queuedMails{0};     ///< in the ingress and the mailqueue, read from any thread
+    MailSpool*          spool{nullptr};
+    RetryScheduler*     retryScheduler{nullptr};
     Mail*               processedMail{nullptr};
     int                 recepientsSent{0};
+    QStringList         envelope;           ///< recepients of the current transaction
+    qint64              messageSize{0};     ///< declared with SIZE, 0 if unknown or not supported by the server
+    QList<RecepientResult> recepientResults;
+    QList<int>          batchSizes;         ///< envelope sizes of the mails sharing the transaction
+    bool                coalescingUsed{false};
+    int                 maxRecepients{MAXRECEPIENTS};
+    int                 serverRecepientLimit{0};    ///< learned from LIMITS or 452 replies, 0 if unknown
     int                 mailsProcessed{0};
     int                 mailsToSend{0};
     int                 tempErrors{0};
@@ -136,9 +218,42 @@ protected:
     QString             username;
     QString             password;
     bool				ignoreSelfSigned{false};
+    QByteArray          offeredTlsSession;  ///< TLS session offered to resume in the handshake
+    bool                tlsSessionPending{false};  ///< a TLS 1.3 session may come with the next reply
+    SmtpCapabilities    capabilities;       ///< announced in the EHLO reply of this session
+    bool                pipeliningUsed{true};
+    bool                chunkingUsed{true};
+    bool                bdatTransfer{false};
+    bool                lastBDATsent{false};
+    SmtpReplyParser     replyParser;
+    std::deque<Pipelined_Command> pipelinedCommands;
+    int                 pipelinedErrorCode{0};
+    QString             pipelinedErrorText;
+    MailStream*         contentStream{nullptr};
+    qint64              contentBytesSent{0};
+    qint64              contentBytesTotal{0};
+    QList<MailResult>   results;
+    QTimer*             handshakeTimer{nullptr};
+    bool                serverLookup{false};    ///< waiting for the addresses of the server
+    bool                connectWhenResolved{false};
+    QList<QHostAddress> serverAddresses;        ///< addresses of the server for the current connect
+    int                 addressesTried{0};      ///< addresses of the server which failed
+    bool                keepAliveUsed{false};
+    int                 keepAliveInterval{KEEPALIVEINTERVAL};
+    int                 idleTimeout{IDLETIMEOUT};
+    QTimer*             keepAliveTimer{nullptr};
+    QTimer*             idleTimer{nullptr};
+    bool                sessionReused{false};   ///< no reply yet to the first command on a session kept alive
+    bool                mailsWaiting{false};    ///< enqueued while busy, sent when the session is idle again
 
     bool                connectToServer();
+    void                connectSocket();
+    bool                connectNextAddress();
+    void                resolveServer();
     void                disconnectFromServer();
+    void                reconnect();
+    void                sessionIdle();
+    void                closeIdleSession(bool quit = false);
     void                sendAUTHLOGIN();
     void                sendSTARTTLS();
     void                sendEHLO();
@@ -146,18 +261,37 @@ protected:
     void                sendTO();
     void                sendDATA();
     void                sendMessagecontent();
+    void                sendBDAT();
+    void                writeMessagecontent();
+    void                abortMessagecontent();
     void                sendQUIT();
+    void                flushCommands();
     void                sendRSET();
+    void                sendPipelinedTransaction();
     void                sendNextMailOrQuit();
-    void                mailProcessed();
+    void                mailProcessed(bool delivered, int replyCode, const QString& replyText);
+    void                mailOfBatchProcessed(bool delivered, int replyCode, const QString& replyText,
+                                             const QStringList& envelope,
+                                             const QList<RecepientResult>& recepientResults);
+    void                groupIdenticalMails();
+    int                 recepientLimit() const;
+    void                retryLater(const Mail& mail);
+    void                startTransaction();
+    void                appendMAILFROM();
+    void                recepientReplyReceived(int replyCode, const QString& replyText);
+    int                 recepientsAccepted(const QList<RecepientResult>& recepients) const;
+    int                 recepientsErrorCode(const QList<RecepientResult>& recepients) const;
+    void                replyReceived();
+    void                pipelinedReplyReceived(int replyCode, const QString& replyText);
+    void                smtpErrorReceived(int replyCode, const QString& errorText);
     QString             pureMailaddressFromAddressstring(const QString &addressstring);
-    bool                validPureMailaddress(const QString& address);
-    bool                validDecoratedAddress(const QString& address);
 
 signals:
     void finishedSending(bool queueEmpty);
     void errorSendingMails(int smtpErrorcode, QString smtpErrorstring);
     void mailsHaveBeenProcessedTillNow(int numberOfMailsProcessed);
+    void readyForMoreMails();
+    void mailBytesSentTillNow(qint64 bytesSent, qint64 bytesTotal);
 
 public slots:
     void     cancelSending();
@@ -166,6 +300,16 @@ protected slots:
     void    dataReadyForReading();
     void    errorReceived(QAbstractSocket::SocketError);
     void    sslErrorsReceived(QList<QSslError>);
+    void    contentBytesWritten(qint64 bytes);
+    void    connectionEstablished();
+    void    connectionEncrypted();
+    void    tlsSessionReceived();
+    void    handshakeTimedOut();
+    void    serverResolved(const QString& host);
+    void    drainIngress();
+    void    sendWaitingMails();
+    void    sendNOOP();
+    void    idleTimedOut();
 
 public slots:
 
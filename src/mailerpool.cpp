@@ -0,0 +1,440 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailerpool.h"
+
+/**
+  * @class MailerPool
+  *
+  * @brief Sends one mailqueue over several parallel SMTP-sessions
+  *
+  * The class holds all mails enqueued with enqueueMail() in one shared queue
+  * and opens up to getMaxConnections() sessions (each one a Mailer) to the
+  * same server when sendAllMails() is called. Whenever a session has finished
+  * a mail it gets the next one from the shared queue, so a slow transaction
+  * doesn't hold up the others. Keep the connection limit below the number of
+  * parallel sessions the server accepts per client.
+  *
+  * The signals are the same as the ones of Mailer and are added up over all
+  * sessions: mailsHaveBeenProcessedTillNow(int) counts the mails of all
+  * sessions, finishedSending(bool) is emitted when the last session has
+  * finished and lastErrors() returns the sum of the errors of all sessions.
+  * Mails with temporary errors are put back to the end of the shared queue.
+  * With a RetryScheduler they are deferred instead and given back to the
+  * session they failed on, the next sendAllMails() collects them from there.
+  */
+
+
+/**
+ * Constructor for a new MailerPool object
+ * @param server    address of the smtp-server to use
+ * @param parent    Qt parent object if present
+ */
+MailerPool::MailerPool(const QString &server, QObject *parent) :
+    QObject(parent), server{server}
+{
+}
+
+
+/**
+ * @brief Returns the number of mails beeing held in the shared mailqueue
+ * @return the size of the mailqueue
+ */
+int MailerPool::sizeOfQueue() const
+{
+    return mailqueue.size();
+}
+
+
+/**
+ * Starts sending all mails in the mailqueue over up to getMaxConnections()
+ * sessions. No more sessions than mails are opened.
+ *
+ * @return false if mailqueue is empty, the pool is already busy or no session could be opened
+ */
+bool MailerPool::sendAllMails()
+{
+    if (isBusy())               return false;
+    foreach (Mailer* session, sessions) takeBackMails(session);
+    if (mailqueue.size() == 0)  return false;
+
+    mailsToSend     = mailqueue.size();
+    mailsHandedOut  = 0;
+    mailsProcessed  = 0;
+    tempErrors      = 0;
+    permErrors      = 0;
+
+    for (int i{0}; i < maxConnections && mailsHandedOut < mailsToSend; i++){
+        Mailer* session = (i < sessions.size()) ? sessions.at(i) : createSession();
+        configureSession(session);
+        handOverMail(session);
+        if (session->sendAllMails()){
+            activeSessions++;
+        } else {
+            takeBackMails(session);
+            mailsHandedOut--;
+        }
+    }
+    return activeSessions > 0;
+}
+
+
+/**
+ * External interface to cancel the sending of mails on all sessions.
+ */
+void MailerPool::cancelSending()
+{
+    foreach (Mailer* session, sessions){
+        if (session->isBusy()) session->cancelSending();
+    }
+}
+
+
+/**
+ * Pushes a mailobject to the end of the shared mailqueue
+ *
+ * @param mail  mailobject to enqueue
+ */
+void MailerPool::enqueueMail(const Mail &mail)
+{
+    mailqueue.push_back(mail);
+}
+
+
+/**
+ * Returns the currently set mailserver
+ *
+ * @return the current mailserverstring
+ */
+QString MailerPool::getServer() const
+{
+    return server;
+}
+
+
+/**
+ * Sets the mailserver to use with the future sendingAllMails()
+ * @param value newMailserver to use
+ */
+void MailerPool::setServer(const QString &value)
+{
+    server = value;
+}
+
+
+/**
+ * Returns true if any session of the pool is still connected to the mailserver
+ *
+ * @return if the pool is busy
+ */
+bool MailerPool::isBusy()
+{
+    return activeSessions > 0;
+}
+
+
+/**
+ * Returns after when the pool is not busy anymore.
+ *
+ * Sleeps in an event loop until finishedSending() is emitted.
+ */
+void MailerPool::waitForProcessing()
+{
+    if (!isBusy()) return;
+    QEventLoop loop;
+    connect(this, SIGNAL(finishedSending(bool)), &loop, SLOT(quit()));
+    loop.exec();
+}
+
+
+/**
+ * Returns the number of mails having errors during the last sendAllMails() summed up
+ * over all sessions.
+ *
+ * @return pair of <tempErrors, permErrors>
+ */
+std::pair<int, int> MailerPool::lastErrors() const
+{
+    return std::pair<int,int>(tempErrors, permErrors);
+}
+
+
+/**
+ * Returns the maximum number of parallel connections to the server
+ * @return connection limit
+ */
+int MailerPool::getMaxConnections() const
+{
+    return maxConnections;
+}
+
+
+/**
+ * Sets the maximum number of parallel connections to the server. Takes effect
+ * with the next sendAllMails().
+ * @param value connection limit, at least 1
+ */
+void MailerPool::setMaxConnections(int value)
+{
+    if (value < 1) return;
+    maxConnections = value;
+}
+
+
+/**
+ * Sets the SMTP-Port the sessions should use for connecting to the server
+ * @param value server-port
+ */
+void MailerPool::setSmtpPort(int value)
+{
+    smtpPort = value;
+}
+
+
+/**
+ * Sets the timeout in milliseconds for new established SMTP-sessions
+ * @param value timeout in milliseconds
+ */
+void MailerPool::setSmtpTimeout(int value)
+{
+    if (value < -1 ) return;
+    smtpTimeout = value;
+}
+
+
+/**
+ * Sets the AUTH-method the sessions use when connecting to the SMTP-server
+ * @param method    method to use
+ */
+void MailerPool::setAUTHMethod(Mailer::SMTP_Auth_Method method)
+{
+    authMethodToUse = method;
+}
+
+
+/**
+ * Sets the password to use for AUTH on the SMTP-server
+ * @param value password in plantext
+ */
+void MailerPool::setPassword(const QString &value)
+{
+    password = value;
+}
+
+
+/**
+ * Sets the username to use for AUTH on the SMTP-server
+ * @param value username in plaintext
+ */
+void MailerPool::setUsername(const QString &value)
+{
+    username = value;
+}
+
+
+/**
+ * Sets the kind of socket-encryption the sessions use
+ * @param value encryption to use
+ */
+void MailerPool::setEncryptionUsed(const Mailer::ENCRYPTION &value)
+{
+    encryptionUsed = value;
+}
+
+
+/**
+ * Ignore self signed certificates on all sessions
+ */
+void MailerPool::ignoreSelfSignedCertificates(bool ignore)
+{
+    ignoreSelfSigned = ignore;
+}
+
+
+/**
+ * Use PIPELINING on all sessions if the server offers it
+ */
+void MailerPool::usePipelining(bool use)
+{
+    pipeliningUsed = use;
+}
+
+
+/**
+ * Use BDAT with BINARYMIME on all sessions if the server offers it
+ */
+void MailerPool::useChunking(bool use)
+{
+    chunkingUsed = use;
+}
+
+
+/**
+ * Uses one RetryScheduler for the mails with temporary errors of all sessions
+ * @param scheduler the scheduler to use, nullptr for none
+ */
+void MailerPool::setRetryScheduler(RetryScheduler *scheduler)
+{
+    retryScheduler = scheduler;
+}
+
+
+/**
+ * Creates a new session and connects its signals to the pool
+ * @return the new session, owned by the pool
+ */
+Mailer* MailerPool::createSession()
+{
+    Mailer* session = new Mailer(server, this);
+    connect(
+            session,
+            SIGNAL(readyForMoreMails()),
+            this,
+            SLOT(sessionReadyForMoreMails())
+            );
+    connect(
+            session,
+            SIGNAL(mailsHaveBeenProcessedTillNow(int)),
+            this,
+            SLOT(sessionMailProcessed())
+            );
+    connect(
+            session,
+            SIGNAL(finishedSending(bool)),
+            this,
+            SLOT(sessionFinished())
+            );
+    connect(
+            session,
+            SIGNAL(errorSendingMails(int,QString)),
+            this,
+            SIGNAL(errorSendingMails(int,QString))
+            );
+    sessions.append(session);
+    return session;
+}
+
+
+/**
+ * Applies the settings of the pool to a session
+ * @param session   session to configure
+ */
+void MailerPool::configureSession(Mailer *session)
+{
+    session->setServer(server);
+    session->setSmtpPort(smtpPort);
+    session->setSmtpTimeout(smtpTimeout);
+    session->setAUTHMethod(authMethodToUse);
+    session->setUsername(username);
+    session->setPassword(password);
+    session->setEncryptionUsed(encryptionUsed);
+    session->ignoreSelfSignedCertificates(ignoreSelfSigned);
+    session->usePipelining(pipeliningUsed);
+    session->useChunking(chunkingUsed);
+    session->setRetryScheduler(retryScheduler);
+}
+
+
+/**
+ * Moves the next mail from the shared queue to a session.
+ *
+ * Every mail is handed out only once per sendAllMails(), mails put back after
+ * temporary errors wait for the next run.
+ *
+ * @param session   session to hand the mail to
+ * @return true if the session got a mail
+ */
+bool MailerPool::handOverMail(Mailer *session)
+{
+    if (mailsHandedOut >= mailsToSend || mailqueue.empty()) return false;
+    session->mailqueue.push_back(mailqueue.front());
+    session->queuedMails++;
+    mailqueue.pop_front();
+    mailsHandedOut++;
+    return true;
+}
+
+
+/**
+ * Moves all mails left in the queue of a session back to the end of the shared
+ * queue. These are mails with temporary errors or mails which couldn't be sent
+ * because the connection broke.
+ *
+ * @param session   session to take the mails from
+ */
+void MailerPool::takeBackMails(Mailer *session)
+{
+    while (!session->mailqueue.empty()){
+        mailqueue.push_back(session->mailqueue.front());
+        session->mailqueue.pop_front();
+        session->queuedMails--;
+    }
+}
+
+
+/**
+ * Called when a session has processed all mails handed to it. Gives it the
+ * next mail of the shared queue to send on the same connection.
+ */
+void MailerPool::sessionReadyForMoreMails()
+{
+    Mailer* session = qobject_cast<Mailer*>(sender());
+    if (!session) return;
+    takeBackMails(session);
+    if (handOverMail(session))
+        session->mailsToSend++;
+}
+
+
+/**
+ * Called when a session processed a mail, emits mailsHaveBeenProcessedTillNow()
+ * with the number of mails processed by all sessions.
+ */
+void MailerPool::sessionMailProcessed()
+{
+    mailsProcessed++;
+    emit mailsHaveBeenProcessedTillNow(mailsProcessed);
+}
+
+
+/**
+ * Called when a session closed its connection. Adds up the errors of the
+ * session and emits finishedSending() when it was the last one.
+ */
+void MailerPool::sessionFinished()
+{
+    Mailer* session = qobject_cast<Mailer*>(sender());
+    if (!session) return;
+    takeBackMails(session);
+    tempErrors += session->lastErrors().first;
+    permErrors += session->lastErrors().second;
+
+    if (activeSessions > 0) activeSessions--;
+    if (activeSessions == 0)
+        emit finishedSending( mailqueue.size() == 0 ? true : false);
+}
@@ -0,0 +1,113 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAILERPOOL_H
+#define MAILERPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <deque>
+#include <utility>
+
+#include "mail.h"
+#include "mailer.h"
+
+#define MAILERPOOL_MAXCONNECTIONS 4
+
+class MailerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MailerPool(const QString &server, QObject *parent = 0);
+
+    int                     sizeOfQueue() const;
+    bool                    sendAllMails();
+    void                    enqueueMail(const Mail& mail);
+    QString                 getServer() const;
+    void                    setServer(const QString &value);
+    bool                    isBusy();
+    void                    waitForProcessing();
+    std::pair<int,int>      lastErrors() const;
+    int                     getMaxConnections() const;
+    void                    setMaxConnections(int value);
+    void                    setSmtpPort(int value);
+    void                    setSmtpTimeout(int value);
+    void                    setAUTHMethod(Mailer::SMTP_Auth_Method);
+    void                    setPassword(const QString &value);
+    void                    setUsername(const QString &value);
+    void                    setEncryptionUsed(const Mailer::ENCRYPTION &value);
+    void                    ignoreSelfSignedCertificates(bool ignore = true);
+    void                    usePipelining(bool use = true);
+    void                    useChunking(bool use = true);
+    void                    setRetryScheduler(RetryScheduler* scheduler);
+
+protected:
+    QString                 server;
+    QList<Mailer*>          sessions;
+    std::deque<Mail>        mailqueue;
+    int                     maxConnections{MAILERPOOL_MAXCONNECTIONS};
+    int                     activeSessions{0};
+    int                     mailsToSend{0};
+    int                     mailsHandedOut{0};
+    int                     mailsProcessed{0};
+    int                     tempErrors{0};
+    int                     permErrors{0};
+    int                     smtpPort{SMTPPORT};
+    int                     smtpTimeout{SMTPTIMEOUT};
+    Mailer::SMTP_Auth_Method authMethodToUse{Mailer::NO_Auth};
+    Mailer::ENCRYPTION      encryptionUsed{Mailer::UNENCRYPTED};
+    QString                 username;
+    QString                 password;
+    bool                    ignoreSelfSigned{false};
+    bool                    pipeliningUsed{true};
+    bool                    chunkingUsed{true};
+    RetryScheduler*         retryScheduler{nullptr};
+
+    Mailer*                 createSession();
+    void                    configureSession(Mailer* session);
+    bool                    handOverMail(Mailer* session);
+    void                    takeBackMails(Mailer* session);
+
+signals:
+    void finishedSending(bool queueEmpty);
+    void errorSendingMails(int smtpErrorcode, QString smtpErrorstring);
+    void mailsHaveBeenProcessedTillNow(int numberOfMailsProcessed);
+
+public slots:
+    void     cancelSending();
+
+protected slots:
+    void    sessionReadyForMoreMails();
+    void    sessionMailProcessed();
+    void    sessionFinished();
+
+};
+
+#endif // MAILERPOOL_H
@@ -0,0 +1,105 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailingress.h"
+
+/**
+  * @class MailIngress
+  *
+  * @brief Lock-free queue handing over mails from many threads to one Mailer.
+  *
+  * Any number of threads may push() at the same time, but only one thread,
+  * the one of the Mailer, may call drainInto(). A push never waits for other
+  * producers or the consumer: it swaps itself in as the newest node and links
+  * the previous one to it (multi-producer/single-consumer queue after
+  * Dmitry Vyukov).
+  *
+  * Between the swap and the link a mail isn't visible to the consumer yet, so
+  * drainInto() may stop before mails pushed already. The caller has to try
+  * again later in that case.
+  */
+
+
+/**
+ * Constructor, creates the empty stub node
+ */
+MailIngress::MailIngress() :
+    head{new Node}
+{
+    tail = head.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Destructor, deletes the mails which were never drained
+ */
+MailIngress::~MailIngress()
+{
+    while (tail){
+        Node* next = tail->next.load(std::memory_order_acquire);
+        delete tail->mail;
+        delete tail;
+        tail = next;
+    }
+}
+
+
+/**
+ * Appends a copy of a mail. Can be called from any thread.
+ * @param mail  mail to append
+ */
+void MailIngress::push(const Mail &mail)
+{
+    Node* node = new Node;
+    node->mail = new Mail(mail);
+    Node* previous = head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+
+/**
+ * Moves all visible mails to the end of a queue. Must only be called from
+ * the consuming thread.
+ * @param queue the queue to append to
+ * @return number of mails moved
+ */
+int MailIngress::drainInto(std::deque<Mail> &queue)
+{
+    int drained{0};
+    Node* next = tail->next.load(std::memory_order_acquire);
+    while (next){
+        queue.push_back(*next->mail);
+        delete next->mail;
+        next->mail = nullptr;
+        delete tail;
+        tail = next;    // the drained node becomes the new stub
+        next = tail->next.load(std::memory_order_acquire);
+        drained++;
+    }
+    return drained;
+}
@@ -0,0 +1,59 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAILINGRESS_H
+#define MAILINGRESS_H
+
+#include <atomic>
+#include <deque>
+
+#include "mail.h"
+
+class MailIngress
+{
+public:
+    MailIngress();
+    ~MailIngress();
+    MailIngress(const MailIngress&) = delete;
+    MailIngress& operator=(const MailIngress&) = delete;
+
+    void    push(const Mail& mail);
+    int     drainInto(std::deque<Mail>& queue);
+
+private:
+    /// Link of the queue, the oldest node is an empty stub
+    struct Node {
+        std::atomic<Node*>  next{nullptr};
+        Mail*               mail{nullptr};
+    };
+
+    std::atomic<Node*>  head;       ///< last node pushed, shared by the producers
+    Node*               tail;       ///< stub before the oldest mail, only used by the consumer
+};
+
+#endif // MAILINGRESS_H
@@ -0,0 +1,279 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailrenderer.h"
+
+#include <cstring>
+
+/**
+  * @class MailRenderer
+  *
+  * @brief Renders the raw maildata of a Mail into one UTF-8 buffer.
+  *
+  * The size of the message is calculated first, so the result is written in
+  * one pass into a single allocation of the exact size: the text parts are
+  * copied line by line while bare LFs are turned into CRLF and dots at the
+  * start of a line are doubled (rfc5321), the attachments are encoded by
+  * Base64Encoder directly into the buffer or copied from the
+  * AttachmentCache. The line ends are found with memchr(), which the C
+  * library implements vectorized.
+  *
+  * The static normalize functions are shared with MailStream.
+  */
+
+
+namespace {
+
+/**
+ * Copies text to out (if out isn't null) with CRLF line endings and dots at
+ * the start of a line doubled if dotStuffing is set.
+ * @return number of bytes the normalized text takes
+ */
+qint64 normalizeText(const char* text, qint64 size, bool dotStuffing,
+                     MailRenderer::LineState& state, char* out)
+{
+    const char* position    = text;
+    const char* end         = text + size;
+    qint64      written{0};
+
+    while (position < end){
+        if (state.lineStart && dotStuffing && *position == '.'){
+            if (out) out[written] = '.';
+            written++;
+        }
+        const char* newline = static_cast<const char*>(memchr(position, '\n', end - position));
+        const char* lineEnd = newline ? newline : end;
+        qint64 length = lineEnd - position;
+        if (length > 0){
+            if (out) memcpy(out + written, position, length);
+            written         += length;
+            state.afterCR   = (lineEnd[-1] == '\r');
+            state.lineStart = false;
+        }
+        if (!newline) break;
+
+        if (!state.afterCR){
+            if (out) out[written] = '\r';
+            written++;
+        }
+        if (out) out[written] = '\n';
+        written++;
+        state.lineStart = true;
+        state.afterCR   = false;
+        position = newline + 1;
+    }
+    return written;
+}
+
+} // namespace
+
+
+/**
+ * Constructor, collects the parts of the mail
+ * @param mail  the mail to render
+ */
+MailRenderer::MailRenderer(const Mail &mail)
+{
+    appendText(mail.headerPart() + mail.bodyPart());
+    for (int i{0}; i < mail.attachments.size(); i++){
+        appendText(mail.attachmentHeader(mail.attachments.at(i)));
+        if (mail.attachments.at(i).exists()){
+            Part part;
+            part.filename = mail.attachments.at(i).absoluteFilePath();
+            parts.append(part);
+        }
+        appendText(mail.attachmentTrailer(i));
+    }
+}
+
+
+/**
+ * The size of the rendered mail, calculated from the sizes of the
+ * attachments without reading them.
+ * @param dotStuffing   false to leave out the dots added for transparency
+ * @return size in bytes including the terminating dot, -1 if an attachment
+ *         is a pipe or special file which doesn't report its size
+ */
+qint64 MailRenderer::size(bool dotStuffing) const
+{
+    qint64      total{0};
+    LineState   state;
+    foreach (const Part& part, parts){
+        if (part.filename.isEmpty()){
+            total += normalizedSize(part.text.constData(), part.text.size(), dotStuffing,
+                                    state);
+        } else {
+            QFileInfo fileinfo(part.filename);
+            if (!fileinfo.isFile() || fileinfo.size() == 0) return -1;
+            total += Base64Encoder::encodedSize(fileinfo.size());
+            state = LineState();
+            state.lineStart = false;
+        }
+    }
+    if (!state.lineStart) total += 2;
+    return total + 3;
+}
+
+
+/**
+ * Renders the mail as it is sent after DATA, terminated by the single dot.
+ * @return the raw maildata
+ */
+QByteArray MailRenderer::render() const
+{
+    // Open the attachments first, so the sizes can't change while writing
+    QList<QFile*>       files;
+    QList<QByteArray>   contents;
+    QList<bool>         encoded;
+    qint64              total{0};
+    LineState           state;
+    foreach (const Part& part, parts){
+        if (part.filename.isEmpty()){
+            total += normalizedSize(part.text.constData(), part.text.size(), true, state);
+            continue;
+        }
+        state = LineState();
+        state.lineStart = false;
+
+        // files attached to many mails are encoded only once
+        QByteArray cached = AttachmentCache::encoded(QFileInfo(part.filename));
+        encoded.append(!cached.isNull());
+        if (!cached.isNull()){
+            contents.append(cached);
+            total += cached.size();
+            continue;
+        }
+
+        QFile* file = new QFile(part.filename);
+        files.append(file);
+        QByteArray content;
+        if (file->open(QFile::ReadOnly)){
+            qint64 filesize = file->isSequential() ? 0 : file->size();
+            uchar* mapped   = (filesize > 0) ? file->map(0, filesize) : nullptr;
+            content = mapped ? QByteArray::fromRawData(reinterpret_cast<const char*>(mapped),
+                                                       filesize)
+                             : file->readAll();
+        }
+        contents.append(content);
+        total += Base64Encoder::encodedSize(content.size());
+    }
+    if (!state.lineStart) total += 2;
+    total += 3;
+
+    QByteArray  result;
+    result.resize(total);
+    char*       out = result.data();
+    int         file{0};
+    state = LineState();
+    foreach (const Part& part, parts){
+        if (part.filename.isEmpty()){
+            out = normalize(part.text.constData(), part.text.size(), true, state, out);
+        } else {
+            const QByteArray& content = contents.at(file);
+            if (encoded.at(file)){
+                memcpy(out, content.constData(), content.size());
+                out += content.size();
+            } else {
+                out = Base64Encoder::encode(content.constData(), content.size(), out);
+            }
+            file++;
+            state = LineState();
+            state.lineStart = false;
+        }
+    }
+    if (!state.lineStart){
+        *out++ = '\r';
+        *out++ = '\n';
+    }
+    memcpy(out, ".\r\n", 3);
+
+    contents.clear();       // drop the references to the mapped files before unmapping
+    qDeleteAll(files);
+    return result;
+}
+
+
+/**
+ * Size of text after normalize()
+ * @param text          text to normalize
+ * @param size          length of the text
+ * @param dotStuffing   true if dots at the start of a line are doubled
+ * @param state         end of the text written before, updated to the end of this text
+ * @return normalized size in bytes
+ */
+qint64 MailRenderer::normalizedSize(const char *text, qint64 size, bool dotStuffing,
+                                    LineState &state)
+{
+    return normalizeText(text, size, dotStuffing, state, nullptr);
+}
+
+
+/**
+ * Copies text with all line endings turned into CRLF and, if dotStuffing is
+ * set, every dot at the start of a line doubled.
+ * @param text          text to normalize
+ * @param size          length of the text
+ * @param dotStuffing   true if dots at the start of a line are doubled
+ * @param state         end of the text written before, updated to the end of this text
+ * @param out           buffer of at least normalizedSize() bytes
+ * @return pointer behind the last written character
+ */
+char* MailRenderer::normalize(const char *text, qint64 size, bool dotStuffing,
+                              LineState &state, char *out)
+{
+    return out + normalizeText(text, size, dotStuffing, state, out);
+}
+
+
+/**
+ * Normalizes text into a new QByteArray, see normalize()
+ * @param text          text to normalize
+ * @param dotStuffing   true if dots at the start of a line are doubled
+ * @param state         end of the text written before, updated to the end of this text
+ * @return normalized text
+ */
+QByteArray MailRenderer::normalized(const QByteArray &text, bool dotStuffing, LineState &state)
+{
+    LineState   start = state;
+    QByteArray  result;
+    result.resize(normalizedSize(text.constData(), text.size(), dotStuffing, state));
+    normalize(text.constData(), text.size(), dotStuffing, start, result.data());
+    return result;
+}
+
+
+/**
+ * Appends text as UTF-8, merged with the previous text part
+ * @param text  text to append
+ */
+void MailRenderer::appendText(const QString &text)
+{
+    if (parts.isEmpty() || !parts.last().filename.isEmpty())
+        parts.append(Part());
+    parts.last().text.append(text.toUtf8());
+}
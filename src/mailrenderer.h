@@ -0,0 +1,73 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAILRENDERER_H
+#define MAILRENDERER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QFile>
+#include <QFileInfo>
+
+#include "mail.h"
+#include "base64encoder.h"
+#include "attachmentcache.h"
+
+class MailRenderer
+{
+public:
+    /// Where the text written so far ends, carried over from one part to the next
+    struct LineState {
+        bool    lineStart{true};
+        bool    afterCR{false};
+    };
+
+    explicit MailRenderer(const Mail& mail);
+
+    qint64              size(bool dotStuffing = true) const;
+    QByteArray          render() const;
+
+    static qint64       normalizedSize(const char* text, qint64 size, bool dotStuffing,
+                                       LineState& state);
+    static char*        normalize(const char* text, qint64 size, bool dotStuffing,
+                                  LineState& state, char* out);
+    static QByteArray   normalized(const QByteArray& text, bool dotStuffing, LineState& state);
+
+protected:
+    /// One part of the message, either text or an attachment to encode in base64
+    struct Part {
+        QByteArray  text;
+        QString     filename;
+    };
+
+    QList<Part>         parts;
+
+    void                appendText(const QString& text);
+};
+
+#endif // MAILRENDERER_H
@@ -0,0 +1,470 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailspool.h"
+
+#include <algorithm>
+#include <QDebug>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+/**
+  * @class MailSpool
+  *
+  * @brief Keeps the mailqueue of a Mailer on disk so it survives restarts.
+  *
+  * Mails are appended to segment files (segment-<n>.spool) in the directory
+  * of the spool, every record holding the envelope, subject, body or the
+  * rendered content of a MailTemplate, and the paths of the attachments.
+  * The index (index.spool) is an append-only list of small fixed size
+  * records telling where a mail is stored and when it is finished.
+  *
+  * Writes are collected and synced to disk together (group commit) at most
+  * MAILSPOOL_SYNCINTERVAL milliseconds after the first one, or at once if
+  * MAILSPOOL_SYNCBYTES are pending. The segments are synced before the index,
+  * so the index never points to data not on disk.
+  *
+  * On startup open() reads only the index, recoverInto() then loads the mails
+  * still pending. From time to time compact() removes the segments of which
+  * all mails are finished and rewrites the index when it holds mostly
+  * finished mails. A new segment is started with every open().
+  *
+  * Mailer stores every enqueued mail when a spool is set and marks it
+  * finished when it was delivered or failed permanently. The spool must only
+  * be used from the thread of that Mailer.
+  */
+
+
+/**
+ * Constructor
+ * @param directory directory for the files of the spool, created if needed
+ * @param parent    Qt parent object
+ */
+MailSpool::MailSpool(const QString &directory, QObject *parent) :
+    QObject(parent), directory{directory}
+{
+    syncTimer = new QTimer(this);
+    syncTimer->setSingleShot(true);
+    connect(
+            syncTimer,
+            SIGNAL(timeout()),
+            this,
+            SLOT(sync())
+            );
+
+    compactTimer = new QTimer(this);
+    connect(
+            compactTimer,
+            SIGNAL(timeout()),
+            this,
+            SLOT(compact())
+            );
+}
+
+
+/**
+ * Destructor, syncs everything not on disk yet
+ */
+MailSpool::~MailSpool()
+{
+    if (isOpen()) sync();
+}
+
+
+/**
+ * Opens the spool and reads the index
+ * @return false if the files of the spool can't be opened
+ */
+bool MailSpool::open()
+{
+    if (isOpen()) return true;
+    if (!QDir().mkpath(directory)) return false;
+
+    indexFile.setFileName(indexPath());
+    if (!indexFile.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) return false;
+
+    QByteArray  records = indexFile.readAll();
+    int         count   = records.size() / MAILSPOOL_INDEXRECORDSIZE;
+    QDataStream stream(records);
+    for (int i{0}; i < count; i++){
+        quint8      type;
+        quint64     id;
+        Location    location;
+        stream >> type >> id >> location.segment >> location.offset;
+        if (type == STORED){
+            pending.insert(id, location);
+        } else if (type == FINISHED){
+            pending.remove(id);
+            finishedRecords++;
+        }
+        nextId = qMax(nextId, id + 1);
+    }
+    // drop a record only partly written before a crash
+    if (records.size() != count * MAILSPOOL_INDEXRECORDSIZE)
+        indexFile.resize(qint64(count) * MAILSPOOL_INDEXRECORDSIZE);
+    indexFile.seek(indexFile.size());
+
+    foreach (const Location& location, pending)
+        pendingPerSegment[location.segment]++;
+
+    QList<quint32> segments = segmentsOnDisk();
+    quint32 segment = segments.isEmpty() ? 1 : segments.last() + 1;
+    if (!openSegment(segment)){
+        indexFile.close();
+        return false;
+    }
+    compactTimer->start(MAILSPOOL_COMPACTINTERVAL);
+    return true;
+}
+
+
+/**
+ * Returns if open() succeeded
+ * @return true if the spool can be used
+ */
+bool MailSpool::isOpen() const
+{
+    return indexFile.isOpen() && segmentFile.isOpen();
+}
+
+
+/**
+ * Appends all mails pending since the spool was opened to a queue in the
+ * order they were stored. Works only once, later calls recover nothing.
+ * @param queue the queue to append to
+ * @return number of mails recovered
+ */
+int MailSpool::recoverInto(std::deque<Mail> &queue)
+{
+    if (recovered || !isOpen()) return 0;
+    recovered = true;
+    QList<quint64> ids = pending.keys();
+    std::sort(ids.begin(), ids.end());
+
+    int     recovered{0};
+    QFile   segment;
+    foreach (quint64 id, ids){
+        Location location = pending.value(id);
+        if (segment.fileName() != segmentPath(location.segment)){
+            segment.close();
+            segment.setFileName(segmentPath(location.segment));
+            segment.open(QIODevice::ReadOnly);
+        }
+
+        QByteArray  payload;
+        quint32     magic{0};
+        quint32     length{0};
+        if (segment.isOpen() && segment.seek(location.offset)){
+            QDataStream header(segment.read(8));
+            header >> magic >> length;
+            if (magic == MAILSPOOL_MAGIC) payload = segment.read(length);
+        }
+        if (payload.size() != int(length) || magic != MAILSPOOL_MAGIC){
+            qDebug() << "Spooled mail not readable: " << id;
+            continue;
+        }
+
+        QDataStream stream(payload);
+        stream.setVersion(QDataStream::Qt_5_0);
+        QStringList to, cc, bcc, attachmentPaths;
+        QString     sender, subject, body;
+        stream >> to >> cc >> bcc >> sender >> subject >> body >> attachmentPaths;
+        QList<QFileInfo> attachments;
+        foreach (const QString& path, attachmentPaths) attachments.append(QFileInfo(path));
+
+        queue.push_back(Mail(to, cc, bcc, sender, subject, body, attachments));
+        Mail& mail = queue.back();
+        // mails of a MailTemplate are rendered from subject and body again
+        QByteArray  unused;
+        stream >> mail.attachmentMimetypes >> mail.extensionMimetypes >> unused
+               >> mail.envelopeRecepients;
+        mail.spoolId = id;
+        recovered++;
+    }
+    return recovered;
+}
+
+
+/**
+ * Stores a mail in the spool and gives it the id to find it again. Mails
+ * having an id already are not stored again.
+ * @param mail  the mail to store
+ * @return false if the spool isn't open
+ */
+bool MailSpool::store(Mail &mail)
+{
+    if (!isOpen()) return false;
+    if (mail.spoolId != 0) return true;
+
+    if (segmentSize + segmentBuffer.size() >= MAILSPOOL_SEGMENTSIZE){
+        if (!sync() || !openSegment(currentSegment + 1)) return false;
+    }
+
+    QByteArray payload = serialized(mail);
+    Location location;
+    location.segment    = currentSegment;
+    location.offset     = segmentSize + segmentBuffer.size();
+    {
+        QDataStream header(&segmentBuffer, QIODevice::Append);
+        header << quint32(MAILSPOOL_MAGIC) << quint32(payload.size());
+    }
+    segmentBuffer.append(payload);
+
+    mail.spoolId = nextId++;
+    appendIndexRecord(indexBuffer, STORED, mail.spoolId, location);
+    pending.insert(mail.spoolId, location);
+    pendingPerSegment[currentSegment]++;
+    scheduleSync();
+    return true;
+}
+
+
+/**
+ * Marks a mail as finished, it won't be recovered anymore
+ * @param mail  a mail stored before
+ */
+void MailSpool::markFinished(const Mail &mail)
+{
+    if (!isOpen() || !pending.contains(mail.spoolId)) return;
+    Location location = pending.take(mail.spoolId);
+    pendingPerSegment[location.segment]--;
+    appendIndexRecord(indexBuffer, FINISHED, mail.spoolId, location);
+    finishedRecords++;
+    scheduleSync();
+}
+
+
+/**
+ * Returns the number of mails stored but not finished
+ * @return number of pending mails
+ */
+int MailSpool::pendingCount() const
+{
+    return pending.size();
+}
+
+
+/**
+ * Sets the longest time stored mails wait for being synced to disk
+ * @param msecs interval in milliseconds, 0 syncs every write at once
+ */
+void MailSpool::setSyncInterval(int msecs)
+{
+    syncInterval = qMax(0, msecs);
+}
+
+
+/**
+ * Writes all collected records and syncs them to disk, the segment first.
+ * If writing fails the files are cut back to the records written before,
+ * so the buffers can be written again at the same offsets.
+ * @return false if writing failed
+ */
+bool MailSpool::sync()
+{
+    syncTimer->stop();
+    if (!isOpen()) return false;
+    if (!segmentBuffer.isEmpty()){
+        if (segmentFile.write(segmentBuffer) != segmentBuffer.size() || !syncToDisk(segmentFile)){
+            qDebug() << "Writing the spool failed: " << segmentFile.errorString();
+            segmentFile.resize(segmentSize);
+            return false;
+        }
+        segmentSize += segmentBuffer.size();
+        segmentBuffer.clear();
+    }
+    if (!indexBuffer.isEmpty()){
+        qint64 indexSize = indexFile.pos();
+        if (indexFile.write(indexBuffer) != indexBuffer.size() || !syncToDisk(indexFile)){
+            qDebug() << "Writing the spool index failed: " << indexFile.errorString();
+            indexFile.resize(indexSize);
+            indexFile.seek(indexSize);
+            return false;
+        }
+        indexBuffer.clear();
+    }
+    return true;
+}
+
+
+/**
+ * Removes the segments of which all mails are finished and rewrites the
+ * index if it holds mostly finished mails. Called regularly while the spool
+ * is open.
+ */
+void MailSpool::compact()
+{
+    // the finished-records have to be on disk before the segments go away
+    if (!sync()) return;
+
+    foreach (quint32 segment, segmentsOnDisk()){
+        if (segment == currentSegment || pendingPerSegment.value(segment) > 0) continue;
+        QFile::remove(segmentPath(segment));
+        pendingPerSegment.remove(segment);
+    }
+
+    if (finishedRecords >= MAILSPOOL_COMPACTRECORDS && finishedRecords > pending.size())
+        rewriteIndex();
+}
+
+
+QString MailSpool::indexPath() const
+{
+    return QDir(directory).filePath("index.spool");
+}
+
+
+QString MailSpool::segmentPath(quint32 segment) const
+{
+    return QDir(directory).filePath(QString("segment-%1.spool").arg(segment, 6, 10, QChar('0')));
+}
+
+
+/**
+ * Numbers of the segment files in the directory, sorted
+ */
+QList<quint32> MailSpool::segmentsOnDisk() const
+{
+    QList<quint32> segments;
+    QStringList files = QDir(directory).entryList(QStringList("segment-*.spool"), QDir::Files);
+    foreach (const QString& file, files){
+        bool ok{false};
+        quint32 segment = file.mid(8, file.size() - 14).toUInt(&ok);
+        if (ok) segments.append(segment);
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+
+/**
+ * Closes the current segment and starts appending to another one
+ */
+bool MailSpool::openSegment(quint32 segment)
+{
+    segmentFile.close();
+    segmentFile.setFileName(segmentPath(segment));
+    if (!segmentFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered))
+        return false;
+    currentSegment  = segment;
+    segmentSize     = segmentFile.size();
+    return true;
+}
+
+
+void MailSpool::appendIndexRecord(QByteArray &buffer, Index_Record type, quint64 id,
+                                  const Location &location) const
+{
+    QDataStream stream(&buffer, QIODevice::Append);
+    stream << quint8(type) << id << location.segment << location.offset;
+}
+
+
+/**
+ * Syncs at once if enough is pending, otherwise after the sync interval
+ */
+void MailSpool::scheduleSync()
+{
+    if (syncInterval == 0 || segmentBuffer.size() + indexBuffer.size() >= MAILSPOOL_SYNCBYTES){
+        sync();
+        return;
+    }
+    if (!syncTimer->isActive()) syncTimer->start(syncInterval);
+}
+
+
+/**
+ * Replaces the index by one holding only the pending mails. The new index is
+ * written and synced to a temporary file which is renamed over the old one,
+ * so a crash leaves either the old or the new index.
+ */
+bool MailSpool::rewriteIndex()
+{
+    QByteArray records;
+    QHash<quint64, Location>::const_iterator entry;
+    for (entry = pending.constBegin(); entry != pending.constEnd(); ++entry)
+        appendIndexRecord(records, STORED, entry.key(), entry.value());
+
+    QSaveFile newIndex(indexPath());
+    if (!newIndex.open(QIODevice::WriteOnly)) return false;
+    if (newIndex.write(records) != records.size() || !syncToDisk(newIndex)){
+        newIndex.cancelWriting();
+        return false;
+    }
+
+    // the old index can't be replaced while it is open on Windows
+    indexFile.close();
+    bool replaced = newIndex.commit();
+    if (!replaced) qDebug() << "Replacing the spool index failed: " << newIndex.errorString();
+    if (!indexFile.open(QIODevice::ReadWrite | QIODevice::Unbuffered)){
+        qDebug() << "Reopening the spool index failed: " << indexFile.errorString();
+        return false;
+    }
+    indexFile.seek(indexFile.size());
+    if (replaced) finishedRecords = 0;
+    return replaced;
+}
+
+
+/**
+ * The record of a mail as stored in a segment (without the header)
+ */
+QByteArray MailSpool::serialized(const Mail &mail) const
+{
+    QStringList attachmentPaths;
+    foreach (const QFileInfo& attachment, mail.attachments)
+        attachmentPaths.append(attachment.absoluteFilePath());
+
+    QByteArray  payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << mail.toRecepients << mail.ccRecepients << mail.bccRecepients << mail.sender
+           << mail.subject << mail.body << attachmentPaths << mail.attachmentMimetypes
+           << mail.extensionMimetypes << QByteArray() << mail.envelopeRecepients;
+    return payload;
+}
+
+
+/**
+ * Flushes a file and makes the operating system write it to the disk
+ */
+bool MailSpool::syncToDisk(QFileDevice &file)
+{
+    if (!file.flush()) return false;
+#if defined(Q_OS_UNIX)
+    return ::fsync(file.handle()) == 0;
+#elif defined(Q_OS_WIN)
+    return ::_commit(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
@@ -0,0 +1,119 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAILSPOOL_H
+#define MAILSPOOL_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QTimer>
+#include <QDataStream>
+#include <deque>
+
+#include "mail.h"
+
+/// A new segment file is started when the current one gets larger
+#define MAILSPOOL_SEGMENTSIZE       (64*1024*1024)
+/// Longest time in milliseconds a stored mail waits for being synced to disk
+#define MAILSPOOL_SYNCINTERVAL      50
+/// Pending data which is synced at once without waiting for the interval
+#define MAILSPOOL_SYNCBYTES         (1024*1024)
+/// Interval in milliseconds for removing delivered segments and rewriting the index
+#define MAILSPOOL_COMPACTINTERVAL   60000
+/// The index is rewritten when it holds more records of finished mails
+#define MAILSPOOL_COMPACTRECORDS    10000
+#define MAILSPOOL_MAGIC             0x4d53504cu
+#define MAILSPOOL_INDEXRECORDSIZE   21
+
+class MailSpool : public QObject
+{
+    Q_OBJECT
+
+    /// Types of the records in the index
+    enum Index_Record {
+        STORED      = 1,
+        FINISHED    = 2
+    };
+
+public:
+    explicit MailSpool(const QString& directory, QObject *parent = 0);
+    ~MailSpool();
+
+    bool        open();
+    bool        isOpen() const;
+    int         recoverInto(std::deque<Mail>& queue);
+    bool        store(Mail& mail);
+    void        markFinished(const Mail& mail);
+    int         pendingCount() const;
+    void        setSyncInterval(int msecs);
+
+public slots:
+    bool        sync();
+    void        compact();
+
+protected:
+    /// Where the record of a mail starts
+    struct Location {
+        quint32 segment{0};
+        qint64  offset{0};
+    };
+
+    QString                 directory;
+    QFile                   indexFile;
+    QFile                   segmentFile;
+    quint32                 currentSegment{0};
+    qint64                  segmentSize{0};
+    QByteArray              segmentBuffer;      ///< records not written yet
+    QByteArray              indexBuffer;
+    QHash<quint64, Location> pending;
+    QHash<quint32, int>     pendingPerSegment;
+    quint64                 nextId{1};
+    int                     finishedRecords{0};
+    bool                    recovered{false};
+    int                     syncInterval{MAILSPOOL_SYNCINTERVAL};
+    QTimer*                 syncTimer{nullptr};
+    QTimer*                 compactTimer{nullptr};
+
+    QString     indexPath() const;
+    QString     segmentPath(quint32 segment) const;
+    QList<quint32> segmentsOnDisk() const;
+    bool        openSegment(quint32 segment);
+    void        appendIndexRecord(QByteArray& buffer, Index_Record type, quint64 id,
+                                  const Location& location) const;
+    void        scheduleSync();
+    bool        rewriteIndex();
+    QByteArray  serialized(const Mail& mail) const;
+    static bool syncToDisk(QFileDevice& file);
+};
+
+#endif // MAILSPOOL_H
@@ -0,0 +1,288 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailstream.h"
+
+#include <cstring>
+
+/**
+  * @class MailStream
+  *
+  * @brief Reads the raw maildata of a Mail in small chunks.
+  *
+  * The class produces the same data as Mail::renderedMail() (encoded as
+  * UTF-8 and terminated by the single dot) but encodes the attachments while
+  * reading. For BDAT_TRANSFER the attachments are left unencoded and the data
+  * is neither dot-stuffed nor terminated. Only MAILSTREAM_CHUNKSIZE bytes of
+  * an encoded attachment are held in memory at once, no matter how large the
+  * file is.
+  *
+  * The text parts are prepared in the constructor, so the Mail can be
+  * destroyed while the stream is still read.
+  */
+
+
+/**
+ * Constructor
+ * @param mail      mail to read the data from
+ * @param transfer  DATA_TRANSFER for DATA, BDAT_TRANSFER for BDAT with BINARYMIME
+ * @param parent    Qt parent object if present
+ */
+MailStream::MailStream(const Mail &mail, TRANSFER transfer, QObject *parent) :
+    QIODevice(parent), transfer{transfer}
+{
+    bool binary = (transfer == BDAT_TRANSFER);
+    // mails from a MailTemplate come rendered for DATA already, the segments
+    // stay shared with the template
+    if (!binary && !mail.templateSegments.isEmpty()){
+        for (int i{0}; i < mail.templateSegments.size(); i++){
+            segments.append(Segment());
+            segments.last().text = mail.templateValues.at(i);
+            segments.append(Segment());
+            segments.last().text = mail.templateSegments.at(i);
+            size += mail.templateValues.at(i).size() + mail.templateSegments.at(i).size();
+        }
+        return;
+    }
+    appendText(mail.headerPart() + mail.bodyPart());
+    for (int i{0}; i < mail.attachments.size(); i++){
+        appendText(mail.attachmentHeader(mail.attachments.at(i), binary));
+        appendFile(mail.attachments.at(i));
+        appendText(mail.attachmentTrailer(i));
+    }
+
+    // Base64 never contains dots or bare LFs, so only the text needs to be cleaned to
+    // fit rfc5321. Attachments always end in the middle of a line.
+    MailRenderer::LineState state;
+    for (int i{0}; i < segments.size(); i++){
+        if (!segments.at(i).filename.isEmpty()){
+            state = MailRenderer::LineState();
+            state.lineStart = false;
+            continue;
+        }
+        segments[i].text = MailRenderer::normalized(segments.at(i).text, !binary, state);
+        size += segments.at(i).text.size();
+    }
+    // BDAT chunks carry their length, so there is no terminating dot
+    if (!binary){
+        appendText(".\r\n");
+        size += 3;
+    }
+}
+
+
+/**
+ * The stream can only be read from the beginning to the end
+ * @return true
+ */
+bool MailStream::isSequential() const
+{
+    return true;
+}
+
+
+/**
+ * @return true if all data of the mail has been read
+ */
+bool MailStream::atEnd() const
+{
+    return bufferPos >= buffer.size() && currentSegment >= segments.size();
+}
+
+
+/**
+ * @return number of bytes which can be read without encoding more data
+ */
+qint64 MailStream::bytesAvailable() const
+{
+    return (buffer.size() - bufferPos) + QIODevice::bytesAvailable();
+}
+
+
+/**
+ * The number of bytes the stream will produce in total, calculated from the
+ * sizes of the attachments without reading them.
+ * @return size of the raw maildata in bytes, -1 if an attachment is a pipe
+ *         or special file which doesn't report its size
+ */
+qint64 MailStream::totalSize() const
+{
+    return sizeKnown ? size : -1;
+}
+
+
+/**
+ * Copies the next bytes of the maildata to data
+ * @param data      buffer to fill
+ * @param maxSize   size of the buffer
+ * @return number of bytes copied, 0 at the end of the mail
+ */
+qint64 MailStream::readData(char *data, qint64 maxSize)
+{
+    qint64 copied{0};
+    while (copied < maxSize){
+        if (bufferPos >= buffer.size() && !fillBuffer()) break;
+        qint64 length = qMin(maxSize - copied, qint64(buffer.size() - bufferPos));
+        memcpy(data + copied, buffer.constData() + bufferPos, length);
+        bufferPos   += length;
+        copied      += length;
+    }
+    return copied;
+}
+
+
+/**
+ * The stream is read only
+ * @return -1
+ */
+qint64 MailStream::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+
+/**
+ * Fills the buffer with the next text segment or the next encoded chunk of
+ * an attachment.
+ *
+ * The attachment is encoded by Base64Encoder in lines of 76 characters each
+ * preceded by CRLF. Regular files are mapped into memory and encoded
+ * without copying, so only the pages currently encoded have to be resident.
+ *
+ * @return false if there is no more data
+ */
+bool MailStream::fillBuffer()
+{
+    buffer.clear();
+    bufferPos = 0;
+    while (buffer.isEmpty() && currentSegment < segments.size()){
+        const Segment& segment = segments.at(currentSegment);
+        if (segment.filename.isEmpty()){
+            buffer = segment.text;
+            currentSegment++;
+            continue;
+        }
+        if (!attachment.isOpen() && transfer == DATA_TRANSFER){
+            // files attached to many mails are encoded only once, the buffer is shared
+            QByteArray cached = AttachmentCache::encoded(QFileInfo(segment.filename));
+            if (!cached.isNull()){
+                buffer = cached;
+                currentSegment++;
+                continue;
+            }
+        }
+        if (!attachment.isOpen()){
+            attachment.setFileName(segment.filename);
+            pending.clear();
+            if (!attachment.open(QFile::ReadOnly)){
+                currentSegment++;
+                continue;
+            }
+            // regular files are encoded straight from the page cache, pipes and
+            // other special files can't be mapped and are read chunk by chunk
+            mapped      = nullptr;
+            mappedPos   = 0;
+            mappedSize  = attachment.isSequential() ? 0 : attachment.size();
+            if (mappedSize > 0) mapped = attachment.map(0, mappedSize);
+        }
+
+        if (mapped){
+            qint64 encodable = qMin(qint64(MAILSTREAM_CHUNKSIZE), mappedSize - mappedPos);
+            const char* data = reinterpret_cast<const char*>(mapped) + mappedPos;
+            if (transfer == BDAT_TRANSFER){
+                buffer = QByteArray(data, encodable);
+            } else {
+                buffer.resize(Base64Encoder::encodedSize(encodable));
+                Base64Encoder::encode(data, encodable, buffer.data());
+            }
+            mappedPos += encodable;
+            if (mappedPos >= mappedSize){
+                attachment.unmap(mapped);
+                mapped = nullptr;
+                attachment.close();
+                currentSegment++;
+            }
+            continue;
+        }
+
+        // files like those in /proc claim to be empty, so only the end of the data counts
+        QByteArray chunk = attachment.read(MAILSTREAM_CHUNKSIZE - pending.size());
+        bool lastChunk = chunk.isEmpty();
+        if (transfer == BDAT_TRANSFER){
+            buffer = chunk;
+            if (lastChunk){
+                attachment.close();
+                currentSegment++;
+            }
+            continue;
+        }
+        pending.append(chunk);
+        // keep an incomplete line for the next chunk, so the line breaks don't move
+        int encodable = lastChunk ? pending.size()
+                                  : pending.size() - pending.size() % BASE64_BYTESPERLINE;
+        buffer.resize(Base64Encoder::encodedSize(encodable));
+        Base64Encoder::encode(pending.constData(), encodable, buffer.data());
+        pending.remove(0, encodable);
+
+        if (lastChunk){
+            attachment.close();
+            currentSegment++;
+        }
+    }
+    return !buffer.isEmpty();
+}
+
+
+/**
+ * Appends text to the stream, merged with the previous text segment
+ * @param text  text to append
+ */
+void MailStream::appendText(const QString &text)
+{
+    if (segments.isEmpty() || !segments.last().filename.isEmpty())
+        segments.append(Segment());
+    segments.last().text.append(text.toUtf8());
+}
+
+
+/**
+ * Appends an attachment which is encoded when the stream reaches it
+ * @param fileinfo  the attached file
+ */
+void MailStream::appendFile(const QFileInfo &fileinfo)
+{
+    if (!fileinfo.exists()) return;
+    Segment segment;
+    segment.filename = fileinfo.absoluteFilePath();
+    segments.append(segment);
+    // pipes, devices and files in /proc don't know how much they will deliver
+    if (!fileinfo.isFile() || fileinfo.size() == 0) sizeKnown = false;
+    size += (transfer == BDAT_TRANSFER) ? fileinfo.size()
+                                        : Base64Encoder::encodedSize(fileinfo.size());
+}
+
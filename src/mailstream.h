@@ -0,0 +1,92 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAILSTREAM_H
+#define MAILSTREAM_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+
+#include "mail.h"
+#include "base64encoder.h"
+#include "mailrenderer.h"
+
+/// Bytes read from an attachment at once, a multiple of the 57 bytes encoded per line
+#define MAILSTREAM_CHUNKSIZE    (BASE64_BYTESPERLINE*1024)
+
+class MailStream : public QIODevice
+{
+    Q_OBJECT
+
+    /// One part of the message, either literal text or an attachment encoded while reading
+    struct Segment {
+        QByteArray  text;
+        QString     filename;
+    };
+
+public:
+    /// Defines how the message is transferred to the server
+    enum TRANSFER {
+        DATA_TRANSFER,      ///< base64 attachments, dot-stuffed and terminated by a single dot
+        BDAT_TRANSFER       ///< binary attachments, sent unchanged in BDAT chunks (rfc3030)
+    };
+
+    explicit MailStream(const Mail& mail, TRANSFER transfer = DATA_TRANSFER, QObject *parent = 0);
+
+    bool        isSequential() const;
+    bool        atEnd() const;
+    qint64      bytesAvailable() const;
+    qint64      totalSize() const;
+
+protected:
+    TRANSFER        transfer{DATA_TRANSFER};
+    QList<Segment>  segments;
+    int             currentSegment{0};
+    QFile           attachment;
+    uchar*          mapped{nullptr};
+    qint64          mappedPos{0};
+    qint64          mappedSize{0};
+    QByteArray      pending;
+    QByteArray      buffer;
+    int             bufferPos{0};
+    qint64          size{0};
+    bool            sizeKnown{true};
+
+    qint64      readData(char *data, qint64 maxSize);
+    qint64      writeData(const char *data, qint64 maxSize);
+    bool        fillBuffer();
+    void        appendText(const QString& text);
+    void        appendFile(const QFileInfo& fileinfo);
+
+};
+
+#endif // MAILSTREAM_H
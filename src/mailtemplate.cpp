@@ -0,0 +1,197 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailtemplate.h"
+
+#include <cstring>
+
+namespace {
+
+/// Counts the lines starting with a dot within rendered text, except the first line
+inline int innerDotLines(const QByteArray& text)
+{
+    int count{0};
+    for (int i{text.indexOf("\n.")}; i >= 0; i = text.indexOf("\n.", i + 1)) count++;
+    return count;
+}
+
+} // namespace
+
+
+/**
+  * @class MailTemplate
+  *
+  * @brief A mail with placeholders for sending personalized mails in bulk.
+  *
+  * Subject and body may contain placeholders like {{name}}. mail() creates a
+  * Mail for one recepient with the placeholders replaced by the values of a
+  * variable map; missing variables are replaced by nothing.
+  *
+  * The template is rendered once when it is created, including all headers,
+  * the MIME structure and the encoded attachments. Each mail only holds the
+  * encoded To:-line and values of the variables, the rendered parts are
+  * shared with the template. Mailer streams both in turn as they are (after
+  * DATA).
+  */
+
+
+/**
+ * Constructor, renders the template
+ * @param sender        sender of the mails
+ * @param subject       subject, may contain placeholders
+ * @param body          body, may contain placeholders
+ * @param attachments   files attached to every mail
+ */
+MailTemplate::MailTemplate(const QString &sender, const QString &subject, const QString &body,
+                           const QList<QFileInfo> &attachments) :
+    prototype(QStringList(), sender, subject, body, attachments)
+{
+    QByteArray rendered = prototype.renderedMail();
+    int headerEnd = rendered.indexOf("\r\n\r\n");
+    int position{0};
+    int open = rendered.indexOf(MAILTEMPLATE_OPEN);
+    while (open >= 0){
+        int nameStart   = open + int(strlen(MAILTEMPLATE_OPEN));
+        int close       = rendered.indexOf(MAILTEMPLATE_CLOSE, nameStart);
+        if (close < 0) break;
+        QByteArray name = rendered.mid(nameStart, close - nameStart);
+        bool validName = !name.isEmpty();
+        for (int i{0}; i < name.size() && validName; i++){
+            char c = name.at(i);
+            validName = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                        (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.';
+        }
+        if (!validName){
+            open = rendered.indexOf(MAILTEMPLATE_OPEN, open + 1);
+            continue;
+        }
+
+        Slot slot;
+        slot.name               = QString::fromLatin1(name);
+        slot.header             = (open < headerEnd);
+        slot.state.lineStart    = (open == 0 || rendered.at(open - 1) == '\n');
+        slot.state.afterCR      = (open > 0 && rendered.at(open - 1) == '\r');
+        slots.append(slot);
+        segments.append(rendered.mid(position, open - position));
+
+        position    = close + int(strlen(MAILTEMPLATE_CLOSE));
+        open        = rendered.indexOf(MAILTEMPLATE_OPEN, position);
+    }
+    segments.append(rendered.mid(position));
+    foreach (const QByteArray& segment, segments) segmentDots.append(innerDotLines(segment));
+}
+
+
+/**
+ * Creates the mail for one recepient
+ * @param toRecepient   recepient of the mail
+ * @param variables     values for the placeholders by name
+ * @return mail ready to be enqueued in a Mailer
+ */
+Mail MailTemplate::mail(const QString &toRecepient, const QHash<QString, QString> &variables) const
+{
+    QByteArray toLine = prototype.recepientHeaderLineFromStringList("To: ",
+                                                                    QStringList(toRecepient)).toUtf8();
+
+    QList<QByteArray> values;
+    values.append(toLine);
+    for (int i{0}; i < slots.size(); i++){
+        QByteArray value = variables.value(slots.at(i).name).toUtf8();
+        if (slots.at(i).header){
+            value.replace('\r', ' ');
+            value.replace('\n', ' ');
+        }
+        MailRenderer::LineState state = slots.at(i).state;
+        value = MailRenderer::normalized(value, true, state);
+        if (state.afterCR){
+            value.append('\n');
+            state.lineStart = true;
+            state.afterCR   = false;
+        }
+        // the following text was rendered as continuing the line of the placeholder
+        if (state.lineStart && segments.at(i + 1).startsWith('.')) value.append('.');
+        values.append(value);
+    }
+
+    // rfc1870 counts the size without the dots added by dot-stuffing, these
+    // are the dots starting a line except the terminating one
+    int     stuffedDots{-1};
+    bool    lineStart{true};
+    for (int i{0}; i < segments.size(); i++){
+        const QByteArray& value = values.at(i);
+        if (!value.isEmpty()){
+            if (lineStart && value.at(0) == '.') stuffedDots++;
+            stuffedDots += innerDotLines(value);
+            lineStart = value.endsWith('\n');
+        }
+        const QByteArray& segment = segments.at(i);
+        if (!segment.isEmpty()){
+            if (lineStart && segment.at(0) == '.') stuffedDots++;
+            stuffedDots += segmentDots.at(i);
+            lineStart = segment.endsWith('\n');
+        }
+    }
+
+    Mail result(toRecepient, prototype.sender, substituted(prototype.subject, variables),
+                substituted(prototype.body, variables));
+    result.attachments          = prototype.attachments;
+    result.templateSegments     = segments;
+    result.templateValues       = values;
+    result.templateStuffedDots  = stuffedDots;
+    return result;
+}
+
+
+/**
+ * Names of all placeholders found in the template
+ * @return placeholder names in the order they appear
+ */
+QStringList MailTemplate::placeholders() const
+{
+    QStringList names;
+    foreach (const Slot& slot, slots){
+        if (!names.contains(slot.name)) names.append(slot.name);
+    }
+    return names;
+}
+
+
+/**
+ * Replaces the placeholders in text by the values of the variables
+ * @param text      subject or body of the template
+ * @param variables values for the placeholders by name
+ * @return text with the placeholders replaced
+ */
+QString MailTemplate::substituted(const QString &text, const QHash<QString, QString> &variables) const
+{
+    QString result = text;
+    foreach (const QString& name, placeholders()){
+        result.replace(MAILTEMPLATE_OPEN + name + MAILTEMPLATE_CLOSE, variables.value(name));
+    }
+    return result;
+}
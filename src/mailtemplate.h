@@ -0,0 +1,74 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAILTEMPLATE_H
+#define MAILTEMPLATE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+#include <QFileInfo>
+
+#include "mail.h"
+#include "mailrenderer.h"
+
+#define MAILTEMPLATE_OPEN   "{{"
+#define MAILTEMPLATE_CLOSE  "}}"
+
+class MailTemplate
+{
+public:
+    explicit MailTemplate(const QString& sender,
+                          const QString& subject,
+                          const QString& body,
+                          const QList<QFileInfo>& attachments = QList<QFileInfo>());
+
+    Mail                mail(const QString& toRecepient,
+                             const QHash<QString, QString>& variables) const;
+    QStringList         placeholders() const;
+
+protected:
+    /// A placeholder in the rendered mail and the position it is found at
+    struct Slot {
+        QString                 name;
+        bool                    header{false};
+        MailRenderer::LineState state;
+    };
+
+    Mail                prototype;
+    QList<QByteArray>   segments;       ///< rendered text around the slots, one more than slots
+    QList<int>          segmentDots;    ///< lines of a segment starting with a dot, but the first
+    QList<Slot>         slots;
+
+    QString             substituted(const QString& text,
+                                    const QHash<QString, QString>& variables) const;
+};
+
+#endif // MAILTEMPLATE_H
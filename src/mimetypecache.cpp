@@ -0,0 +1,103 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mimetypecache.h"
+
+/**
+  * @class MimetypeCache
+  *
+  * @brief Process-wide cache for the mimetypes of attachments.
+  *
+  * Looking at the content of a file to find its mimetype reads the file, so
+  * the result is remembered for the path, size and modification time of the
+  * file. A mail which is retried or a file attached to many mails is looked
+  * at only once. Lookups by the file extension alone are cached by filename.
+  *
+  * The cache can be used from several threads.
+  */
+
+
+/**
+ * Mimetype of a file, looked up only if the file changed since the last call
+ * @param fileinfo      the file
+ * @param extensionOnly true to guess the mimetype from the filename without reading the file
+ * @return name of the mimetype, an empty string if the file doesn't exist
+ */
+QString MimetypeCache::mimetypeForFile(const QFileInfo &fileinfo, bool extensionOnly)
+{
+    QString key;
+    if (extensionOnly){
+        key = QLatin1String("*") + fileinfo.fileName();
+    } else {
+        // don't trust a QFileInfo which may have been created long ago
+        QFileInfo current(fileinfo.absoluteFilePath());
+        if (!current.exists()) return QString();
+        key = current.absoluteFilePath() + QLatin1Char('\n') + QString::number(current.size()) +
+              QLatin1Char('\n') + QString::number(current.lastModified().toMSecsSinceEpoch());
+    }
+
+    {
+        QMutexLocker locker(&mutex());
+        QHash<QString, QString>::const_iterator entry = cache().constFind(key);
+        if (entry != cache().constEnd()) return entry.value();
+    }
+
+    QMimeDatabase mimedatabase;
+    QString mimetype = extensionOnly ?
+                mimedatabase.mimeTypeForFile(fileinfo, QMimeDatabase::MatchExtension).name() :
+                mimedatabase.mimeTypeForFile(fileinfo.absoluteFilePath()).name();
+
+    QMutexLocker locker(&mutex());
+    if (cache().size() >= MIMETYPECACHE_MAXENTRIES) cache().clear();
+    cache().insert(key, mimetype);
+    return mimetype;
+}
+
+
+/**
+ * Forgets all cached mimetypes
+ */
+void MimetypeCache::clear()
+{
+    QMutexLocker locker(&mutex());
+    cache().clear();
+}
+
+
+QMutex& MimetypeCache::mutex()
+{
+    static QMutex cacheMutex;
+    return cacheMutex;
+}
+
+
+QHash<QString, QString>& MimetypeCache::cache()
+{
+    static QHash<QString, QString> mimetypes;
+    return mimetypes;
+}
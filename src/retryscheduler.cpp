@@ -0,0 +1,221 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "retryscheduler.h"
+#include "mailer.h"
+
+#include <QDebug>
+
+/**
+  * @class RetryScheduler
+  *
+  * @brief Holds back mails with temporary errors until their retry is due.
+  *
+  * A Mailer using a RetryScheduler hands over every mail with a temporary
+  * error to defer() instead of putting it to the back of its mailqueue. The
+  * scheduler counts the failed attempts for the server and for every
+  * recepient domain of the mail and holds the mail back for an exponential
+  * backoff: the base delay, doubled with every failure up to the maximum
+  * delay, of which a random part of up to one half is taken away (jitter),
+  * so mails deferred together don't come back all at once. Mails failing
+  * while a destination is backed off already count as the same attempt. A
+  * mail waits at least as long as any of its destinations is backed off. A
+  * delivery resets the backoff of its server and domains.
+  *
+  * The deferred mails are kept ordered by due time with one timer for the
+  * earliest. When it is due the mail is given back to its Mailer with
+  * enqueueMail() and mailsDue() is emitted. Nothing else looks at the
+  * deferred mails.
+  *
+  * One scheduler can be shared by several Mailers living in the same thread,
+  * MailerPool::setRetryScheduler() hands it to all sessions of a pool.
+  */
+
+
+/**
+ * Constructor
+ * @param parent    Qt parent object
+ */
+RetryScheduler::RetryScheduler(QObject *parent) :
+    QObject(parent), random{std::random_device()()}
+{
+    clock.start();
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(
+            timer,
+            SIGNAL(timeout()),
+            this,
+            SLOT(releaseDueMails())
+            );
+}
+
+
+/**
+ * Holds a mail back until the backoff of its server and domains has passed
+ * @param mail      mail having a temporary error
+ * @param mailer    Mailer to give the mail back to
+ */
+void RetryScheduler::defer(const Mail &mail, Mailer *mailer)
+{
+    QStringList destinations = keys(mail, mailer->getServer());
+    qint64  now = clock.elapsed();
+    int     failures{0};
+    qint64  until{0};
+    foreach (const QString& key, destinations){
+        Backoff& backoff = backoffs[key];
+        if (backoff.until <= now) backoff.failures++;
+        failures    = qMax(failures, backoff.failures);
+        until       = qMax(until, backoff.until);
+    }
+
+    qint64 delay = baseDelay;
+    for (int i{1}; i < failures && delay < maxDelay; i++) delay *= 2;
+    delay = qMin<qint64>(delay, maxDelay);
+    delay -= std::uniform_int_distribution<qint64>(0, delay / 2)(random);
+
+    qint64 due = qMax(now + delay, until);
+    // only the first mail of an attempt sets the backoff, the others just wait for it
+    foreach (const QString& key, destinations){
+        Backoff& backoff = backoffs[key];
+        if (backoff.until <= now) backoff.until = due;
+    }
+
+    Deferred entry{mail, mailer};
+    deferred.insert(std::make_pair(due, entry));
+    startTimer();
+}
+
+
+/**
+ * Resets the backoff of the server and the domains of a delivered mail
+ * @param mail      the delivered mail
+ * @param server    server which accepted the mail
+ */
+void RetryScheduler::delivered(const Mail &mail, const QString &server)
+{
+    if (backoffs.isEmpty()) return;
+    foreach (const QString& key, keys(mail, server)) backoffs.remove(key);
+}
+
+
+/**
+ * Time until a mail to these destinations would be retried at the earliest
+ * @param mail      the mail
+ * @param server    server to send it to
+ * @return remaining backoff in milliseconds, 0 if there is none
+ */
+qint64 RetryScheduler::backoff(const Mail &mail, const QString &server) const
+{
+    qint64 until{0};
+    foreach (const QString& key, keys(mail, server))
+        until = qMax(until, backoffs.value(key).until);
+    return qMax<qint64>(0, until - clock.elapsed());
+}
+
+
+/**
+ * Returns the number of mails waiting for their retry
+ * @return number of deferred mails
+ */
+int RetryScheduler::deferredCount() const
+{
+    return int(deferred.size());
+}
+
+
+/**
+ * Sets the delay after the first temporary error
+ * @param msecs delay in milliseconds
+ */
+void RetryScheduler::setBaseDelay(int msecs)
+{
+    if (msecs < 1) return;
+    baseDelay = msecs;
+}
+
+
+/**
+ * Sets the longest delay between two tries
+ * @param msecs delay in milliseconds
+ */
+void RetryScheduler::setMaxDelay(int msecs)
+{
+    if (msecs < 1) return;
+    maxDelay = msecs;
+}
+
+
+/**
+ * The backoff states a mail depends on: its server and recepient domains
+ */
+QStringList RetryScheduler::keys(const Mail &mail, const QString &server) const
+{
+    QStringList result(QLatin1String("server:") + server.toLower());
+    foreach (const QString& recepient, mail.getEnvelopeRecepients()){
+        QString key = QLatin1String("domain:") + MailAddress::domainPart(recepient).toString().toLower();
+        if (!result.contains(key)) result.append(key);
+    }
+    return result;
+}
+
+
+/**
+ * Sets the timer to the earliest due time
+ */
+void RetryScheduler::startTimer()
+{
+    if (deferred.empty()){
+        timer->stop();
+        return;
+    }
+    qint64 wait = deferred.begin()->first - clock.elapsed();
+    timer->start(int(qBound<qint64>(0, wait, RETRYSCHEDULER_MAXDELAY)));
+}
+
+
+/**
+ * Gives all mails being due back to their Mailers
+ */
+void RetryScheduler::releaseDueMails()
+{
+    int     released{0};
+    qint64  now = clock.elapsed();
+    while (!deferred.empty() && deferred.begin()->first <= now){
+        const Deferred& entry = deferred.begin()->second;
+        if (entry.mailer){
+            entry.mailer->enqueueMail(entry.mail);
+            released++;
+        } else {
+            qDebug() << "Mailer gone, deferred mail dropped";
+        }
+        deferred.erase(deferred.begin());
+    }
+    startTimer();
+    if (released > 0) emit mailsDue(released);
+}
@@ -0,0 +1,96 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RETRYSCHEDULER_H
+#define RETRYSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QTimer>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <map>
+#include <random>
+
+#include "mail.h"
+
+/// Delay in milliseconds after the first temporary error
+#define RETRYSCHEDULER_BASEDELAY    60000
+/// Longest delay in milliseconds, however often a destination failed
+#define RETRYSCHEDULER_MAXDELAY     3600000
+
+class Mailer;
+
+class RetryScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RetryScheduler(QObject *parent = 0);
+
+    void        defer(const Mail& mail, Mailer* mailer);
+    void        delivered(const Mail& mail, const QString& server);
+    qint64      backoff(const Mail& mail, const QString& server) const;
+    int         deferredCount() const;
+    void        setBaseDelay(int msecs);
+    void        setMaxDelay(int msecs);
+
+signals:
+    void        mailsDue(int numberOfMails);
+
+protected:
+    /// Backoff state of one server or recepient domain
+    struct Backoff {
+        int     failures{0};
+        qint64  until{0};           ///< no retry before, on clock
+    };
+
+    /// A mail waiting for its retry and the mailer to give it back to
+    struct Deferred {
+        Mail                mail;
+        QPointer<Mailer>    mailer;
+    };
+
+    QHash<QString, Backoff>         backoffs;
+    std::multimap<qint64, Deferred> deferred;       ///< ordered by due time
+    QTimer*                         timer{nullptr};
+    QElapsedTimer                   clock;
+    std::mt19937                    random;
+    int                             baseDelay{RETRYSCHEDULER_BASEDELAY};
+    int                             maxDelay{RETRYSCHEDULER_MAXDELAY};
+
+    QStringList keys(const Mail& mail, const QString& server) const;
+    void        startTimer();
+
+protected slots:
+    void        releaseDueMails();
+};
+
+#endif // RETRYSCHEDULER_H
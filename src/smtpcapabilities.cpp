@@ -0,0 +1,207 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "smtpcapabilities.h"
+
+/**
+  * @class SmtpCapabilities
+  *
+  * @brief The service extensions a server announces in its EHLO reply (rfc5321 4.1.1.1).
+  *
+  * Every line of the reply after the greeting holds a keyword and its
+  * parameters, e.g. "SIZE 35882577" or "AUTH PLAIN LOGIN". Keywords are
+  * compared case insensitive.
+  *
+  * The capabilities of a server rarely change, so Mailer keeps the ones of
+  * the last session in a process-wide cache per server and port. They are
+  * known before a new session has even connected and can be used to decide
+  * how to send up front.
+  */
+
+
+/**
+ * Constructor for a server which announced nothing
+ */
+SmtpCapabilities::SmtpCapabilities()
+{
+}
+
+
+/**
+ * Constructor, parses an EHLO reply
+ * @param ehloReply all lines of the reply including the reply codes
+ */
+SmtpCapabilities::SmtpCapabilities(const QStringList &ehloReply)
+{
+    // the first line is the greeting of the server
+    for (int i{1}; i < ehloReply.size(); i++){
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        QStringList words = ehloReply.at(i).mid(4).split(' ', Qt::SkipEmptyParts);
+#else
+        QStringList words = ehloReply.at(i).mid(4).split(' ', QString::SkipEmptyParts);
+#endif
+        if (words.isEmpty()) continue;
+        QString keyword = words.takeFirst().toUpper();
+        // old servers announce "AUTH=LOGIN" as well
+        if (keyword.startsWith("AUTH=")){
+            words.prepend(keyword.mid(5));
+            keyword = "AUTH";
+            words = extensions.value(keyword) + words;
+        }
+        extensions.insert(keyword, words);
+    }
+}
+
+
+/**
+ * Returns true if nothing is announced, e.g. if the server wasn't asked yet
+ */
+bool SmtpCapabilities::isEmpty() const
+{
+    return extensions.isEmpty();
+}
+
+
+/**
+ * All keywords announced, in upper case
+ */
+QStringList SmtpCapabilities::keywords() const
+{
+    return extensions.keys();
+}
+
+
+/**
+ * Tests if the server announced an extension
+ * @param keyword   keyword of the extension, e.g. "PIPELINING"
+ * @return true if announced
+ */
+bool SmtpCapabilities::has(const QString &keyword) const
+{
+    return extensions.contains(keyword.toUpper());
+}
+
+
+/**
+ * The parameters announced with an extension
+ * @param keyword   keyword of the extension, e.g. "AUTH"
+ * @return parameters as given by the server
+ */
+QStringList SmtpCapabilities::parameters(const QString &keyword) const
+{
+    return extensions.value(keyword.toUpper());
+}
+
+
+/**
+ * The largest message the server accepts (rfc1870)
+ * @return size in bytes, 0 if there is no limit or SIZE isn't announced
+ */
+qint64 SmtpCapabilities::sizeLimit() const
+{
+    QStringList size = parameters("SIZE");
+    return size.isEmpty() ? 0 : size.first().toLongLong();
+}
+
+
+/**
+ * The SASL mechanisms announced with AUTH (rfc4954), in upper case
+ */
+QStringList SmtpCapabilities::authMechanisms() const
+{
+    QStringList mechanisms;
+    foreach (const QString& mechanism, parameters("AUTH")){
+        QString upper = mechanism.toUpper();
+        if (!mechanisms.contains(upper)) mechanisms.append(upper);
+    }
+    return mechanisms;
+}
+
+
+/**
+ * The number of recepients of one transaction announced with LIMITS (rfc9422)
+ * @return RCPTMAX, 0 if not announced
+ */
+int SmtpCapabilities::recepientLimit() const
+{
+    foreach (const QString& limit, parameters("LIMITS")){
+        if (limit.toUpper().startsWith("RCPTMAX=")) return limit.mid(8).toInt();
+    }
+    return 0;
+}
+
+
+/**
+ * The capabilities a server announced in its last session
+ * @param server    name of the server
+ * @param port      port of the server
+ * @return capabilities, empty if the server wasn't asked yet
+ */
+SmtpCapabilities SmtpCapabilities::cached(const QString &server, int port)
+{
+    QMutexLocker locker(&mutex());
+    return servers().value(server.toLower() + ':' + QString::number(port));
+}
+
+
+/**
+ * Remembers the capabilities of a server for later sessions
+ * @param server        name of the server
+ * @param port          port of the server
+ * @param capabilities  capabilities announced
+ */
+void SmtpCapabilities::cache(const QString &server, int port, const SmtpCapabilities &capabilities)
+{
+    QMutexLocker locker(&mutex());
+    if (servers().size() >= SMTPCAPABILITIES_MAXENTRIES) servers().clear();
+    servers().insert(server.toLower() + ':' + QString::number(port), capabilities);
+}
+
+
+/**
+ * Forgets the capabilities of all servers
+ */
+void SmtpCapabilities::clearCache()
+{
+    QMutexLocker locker(&mutex());
+    servers().clear();
+}
+
+
+QMutex& SmtpCapabilities::mutex()
+{
+    static QMutex cacheMutex;
+    return cacheMutex;
+}
+
+
+QHash<QString, SmtpCapabilities>& SmtpCapabilities::servers()
+{
+    static QHash<QString, SmtpCapabilities> capabilities;
+    return capabilities;
+}
@@ -0,0 +1,66 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SMTPCAPABILITIES_H
+#define SMTPCAPABILITIES_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+
+/// Number of servers remembered before the cache is cleared
+#define SMTPCAPABILITIES_MAXENTRIES 256
+
+class SmtpCapabilities
+{
+public:
+    SmtpCapabilities();
+    explicit SmtpCapabilities(const QStringList& ehloReply);
+
+    bool            isEmpty() const;
+    QStringList     keywords() const;
+    bool            has(const QString& keyword) const;
+    QStringList     parameters(const QString& keyword) const;
+    qint64          sizeLimit() const;
+    QStringList     authMechanisms() const;
+    int             recepientLimit() const;
+
+    static SmtpCapabilities cached(const QString& server, int port);
+    static void             cache(const QString& server, int port,
+                                  const SmtpCapabilities& capabilities);
+    static void             clearCache();
+
+private:
+    QHash<QString, QStringList> extensions;     ///< keyword (upper case) => parameters
+
+    static QMutex&                              mutex();
+    static QHash<QString, SmtpCapabilities>&    servers();
+};
+
+#endif // SMTPCAPABILITIES_H
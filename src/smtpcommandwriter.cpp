@@ -0,0 +1,182 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "smtpcommandwriter.h"
+
+#include <cstring>
+
+/**
+  * @class SmtpCommandWriter
+  *
+  * @brief Collects the commands sent to the SMTP-server as bytes and writes them at once.
+  *
+  * The commands are formatted right into a fixed buffer, addresses given as
+  * QString are copied as ASCII and only encoded as UTF-8 if they have to be
+  * (rfc6531). Nothing is written to the device before flush() is called, so
+  * all commands of one protocol turn, e.g. a pipelined transaction (rfc2920),
+  * go out with a single write.
+  *
+  * If the buffer is full the commands collected so far are written before.
+  */
+
+
+/**
+ * Constructor for a writer without device
+ */
+SmtpCommandWriter::SmtpCommandWriter()
+{
+}
+
+
+/**
+ * Sets the device the commands are written to by flush()
+ * @param device    socket connected to the server
+ */
+void SmtpCommandWriter::setDevice(QIODevice *device)
+{
+    this->device = device;
+}
+
+
+/**
+ * Appends a text, e.g. a command including its "\r\n"
+ * @param text  zero terminated ASCII text
+ * @return the writer
+ */
+SmtpCommandWriter& SmtpCommandWriter::append(const char *text)
+{
+    return append(text, int(std::strlen(text)));
+}
+
+
+/**
+ * Appends bytes, more than fit into the buffer are written directly
+ * @param data      bytes to append
+ * @param length    number of bytes
+ * @return the writer
+ */
+SmtpCommandWriter& SmtpCommandWriter::append(const char *data, int length)
+{
+    if (size + length > SMTPCOMMAND_BUFFERSIZE) flush();
+    if (length > SMTPCOMMAND_BUFFERSIZE){
+        if (device) device->write(data, length);
+        return *this;
+    }
+    std::memcpy(buffer + size, data, length);
+    size += length;
+    return *this;
+}
+
+
+/**
+ * Appends bytes, e.g. base64 encoded credentials
+ * @param data  bytes to append
+ * @return the writer
+ */
+SmtpCommandWriter& SmtpCommandWriter::append(const QByteArray &data)
+{
+    return append(data.constData(), data.size());
+}
+
+
+/**
+ * Appends a text, as ASCII if it is ASCII and as UTF-8 if not
+ * @param text  text to append
+ * @return the writer
+ */
+SmtpCommandWriter& SmtpCommandWriter::append(const QString &text)
+{
+    const QChar* chars  = text.constData();
+    int          length = text.size();
+    for (int i{0}; i < length; i++)
+        if (chars[i].unicode() >= 0x80) return append(text.toUtf8());
+
+    if (length > SMTPCOMMAND_BUFFERSIZE) return append(text.toLatin1());
+    if (size + length > SMTPCOMMAND_BUFFERSIZE) flush();
+    for (int i{0}; i < length; i++) buffer[size++] = char(chars[i].unicode());
+    return *this;
+}
+
+
+/**
+ * Appends a number in decimal, e.g. the size of a BDAT chunk
+ * @param value number to append
+ * @return the writer
+ */
+SmtpCommandWriter& SmtpCommandWriter::appendNumber(qint64 value)
+{
+    char    digits[24];
+    int     pos{24};
+    quint64 rest = value < 0 ? 0 - quint64(value) : quint64(value);
+    do {
+        digits[--pos] = char('0' + rest % 10);
+        rest /= 10;
+    } while (rest > 0);
+    if (value < 0) digits[--pos] = '-';
+    return append(digits + pos, 24 - pos);
+}
+
+
+/**
+ * Writes all commands collected to the device with one write
+ * @return number of bytes written, -1 on an error
+ */
+qint64 SmtpCommandWriter::flush()
+{
+    if (size == 0) return 0;
+    qint64 written = device ? device->write(buffer, size) : -1;
+    size = 0;
+    return written;
+}
+
+
+/**
+ * Drops the commands collected, e.g. when the connection was closed
+ */
+void SmtpCommandWriter::clear()
+{
+    size = 0;
+}
+
+
+/**
+ * Number of bytes collected and not written yet
+ */
+int SmtpCommandWriter::pendingSize() const
+{
+    return size;
+}
+
+
+/**
+ * Copy of the commands collected and not written yet, e.g. for debugging
+ */
+QByteArray SmtpCommandWriter::pending() const
+{
+    return QByteArray(buffer, size);
+}
@@ -0,0 +1,61 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SMTPCOMMANDWRITER_H
+#define SMTPCOMMANDWRITER_H
+
+#include <QIODevice>
+#include <QString>
+#include <QByteArray>
+
+/// Bytes of commands collected before they are written, a whole pipelined transaction fits usually
+#define SMTPCOMMAND_BUFFERSIZE  4096
+
+class SmtpCommandWriter
+{
+public:
+    SmtpCommandWriter();
+
+    void                setDevice(QIODevice* device);
+    SmtpCommandWriter&  append(const char* text);
+    SmtpCommandWriter&  append(const char* data, int length);
+    SmtpCommandWriter&  append(const QByteArray& data);
+    SmtpCommandWriter&  append(const QString& text);
+    SmtpCommandWriter&  appendNumber(qint64 value);
+    qint64              flush();
+    void                clear();
+    int                 pendingSize() const;
+    QByteArray          pending() const;
+
+private:
+    QIODevice*          device{nullptr};
+    char                buffer[SMTPCOMMAND_BUFFERSIZE];
+    int                 size{0};
+};
+
+#endif // SMTPCOMMANDWRITER_H
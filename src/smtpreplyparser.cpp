@@ -0,0 +1,277 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "smtpreplyparser.h"
+
+#include <cstring>
+
+/**
+  * @class SmtpReplyParser
+  *
+  * @brief Splits the bytes received from the SMTP-server into replies (rfc5321 4.2).
+  *
+  * The bytes are read from the socket into a ring buffer and parsed as they
+  * arrive. A reply may be split over several reads and one read may hold
+  * several replies, as it happens when pipelining. Lines like "250-..."
+  * announce more lines of the reply, a line like "250 ..." is its last one.
+  *
+  * The code, the enhanced status code (rfc3463, e.g. "5.1.1") and all lines
+  * of a reply are kept until the next reply is parsed. Nothing is allocated
+  * while parsing, only text() and lines() create strings.
+  */
+
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+
+/**
+ * Constructor for an empty parser
+ */
+SmtpReplyParser::SmtpReplyParser()
+{
+}
+
+
+/**
+ * Reads the bytes available from the device, as many as fit into the buffer
+ * @param device    socket connected to the server
+ * @return number of bytes read
+ */
+qint64 SmtpReplyParser::readFrom(QIODevice *device)
+{
+    qint64 total{0};
+    for (;;){
+        quint32 free        = SMTPREPLY_BUFFERSIZE - (writePos - readPos);
+        quint32 offset      = writePos & (SMTPREPLY_BUFFERSIZE - 1);
+        quint32 contiguous  = qMin(free, quint32(SMTPREPLY_BUFFERSIZE) - offset);
+        if (contiguous == 0) break;
+        qint64 bytes = device->read(ring + offset, contiguous);
+        if (bytes <= 0) break;
+        writePos    += quint32(bytes);
+        total       += bytes;
+    }
+    return total;
+}
+
+
+/**
+ * Parses the bytes read until the next reply is complete
+ * @return true if a reply is complete, false if more bytes are needed
+ */
+bool SmtpReplyParser::nextReply()
+{
+    if (replyComplete){
+        replySize       = 0;
+        numberOfLines   = 0;
+        replyCode       = 0;
+        statusStart     = 0;
+        statusLength    = 0;
+        replyComplete   = false;
+    }
+    while (scanPos != writePos){
+        if (ring[scanPos++ & (SMTPREPLY_BUFFERSIZE - 1)] != '\n') continue;
+        lineReceived(readPos, scanPos - 1);
+        readPos = scanPos;
+        if (replyComplete) return true;
+    }
+    // a line filling the whole buffer is taken as far as it got, the rest is skipped
+    if (writePos - readPos == SMTPREPLY_BUFFERSIZE){
+        lineReceived(readPos, writePos);
+        readPos     = writePos;
+        skipLine    = true;
+    }
+    return replyComplete;
+}
+
+
+/**
+ * Drops all bytes read and the last reply, e.g. when connecting again
+ */
+void SmtpReplyParser::clear()
+{
+    readPos         = 0;
+    scanPos         = 0;
+    writePos        = 0;
+    skipLine        = false;
+    replySize       = 0;
+    numberOfLines   = 0;
+    replyCode       = 0;
+    statusStart     = 0;
+    statusLength    = 0;
+    replyComplete   = false;
+}
+
+
+/**
+ * The three digit code of the last reply, 0 if the reply was malformed
+ */
+int SmtpReplyParser::code() const
+{
+    return replyCode;
+}
+
+
+/**
+ * The enhanced status code (rfc3463) at the start of the last line of the
+ * reply, e.g. "5.1.1"
+ * @return the status code, empty if the server sent none
+ */
+QLatin1String SmtpReplyParser::enhancedStatus() const
+{
+    return QLatin1String(reply + statusStart, statusLength);
+}
+
+
+/**
+ * Number of lines of the reply, at most SMTPREPLY_MAXLINES
+ */
+int SmtpReplyParser::lineCount() const
+{
+    return numberOfLines;
+}
+
+
+/**
+ * The text of one line of the reply without the code, points into the parser
+ * and is valid until the next reply is parsed
+ * @param index number of the line, starting with 0
+ * @return text of the line
+ */
+QLatin1String SmtpReplyParser::line(int index) const
+{
+    if (index < 0 || index >= numberOfLines) return QLatin1String();
+    int start   = lineStart(index);
+    int length  = lineEnds[index] - start;
+    if (length <= 4) return QLatin1String();
+    return QLatin1String(reply + start + 4, length - 4);
+}
+
+
+/**
+ * All lines of the reply as received, seperated by newlines
+ */
+QString SmtpReplyParser::text() const
+{
+    QString text;
+    for (int i{0}; i < numberOfLines; i++){
+        if (i > 0) text.append('\n');
+        text.append(QString::fromUtf8(reply + lineStart(i), lineEnds[i] - lineStart(i)));
+    }
+    return text;
+}
+
+
+/**
+ * All lines of the reply as received, including the codes
+ */
+QStringList SmtpReplyParser::lines() const
+{
+    QStringList lines;
+    for (int i{0}; i < numberOfLines; i++)
+        lines.append(QString::fromUtf8(reply + lineStart(i), lineEnds[i] - lineStart(i)));
+    return lines;
+}
+
+
+/**
+ * Copies a line from the ring buffer to the reply and checks if it is the
+ * last line of the reply
+ * @param start position of the first byte of the line
+ * @param end   position of the line feed ending the line
+ */
+void SmtpReplyParser::lineReceived(quint32 start, quint32 end)
+{
+    if (skipLine){
+        skipLine = false;
+        return;
+    }
+    if (end != start && ring[(end - 1) & (SMTPREPLY_BUFFERSIZE - 1)] == '\r') end--;
+
+    // the lines before the last one are dropped if the reply gets too long
+    quint32 length = end - start;
+    while (numberOfLines > 0 && (numberOfLines == SMTPREPLY_MAXLINES ||
+                                 replySize + length > SMTPREPLY_MAXSIZE)){
+        numberOfLines--;
+        replySize = lineStart(numberOfLines);
+    }
+    length = qMin(length, quint32(SMTPREPLY_MAXSIZE - replySize));
+
+    quint32 offset  = start & (SMTPREPLY_BUFFERSIZE - 1);
+    quint32 first   = qMin(length, quint32(SMTPREPLY_BUFFERSIZE) - offset);
+    char*   text    = reply + replySize;
+    std::memcpy(text, ring + offset, first);
+    std::memcpy(text + first, ring, length - first);
+    replySize += length;
+    lineEnds[numberOfLines++] = replySize;
+
+    // "250-..." announces more lines, "250 ..." or "250" is the last one
+    if (length > 3 && text[3] == '-') return;
+    replyComplete = true;
+    if (length < 3 || !isDigit(text[0]) || !isDigit(text[1]) || !isDigit(text[2])) return;
+    replyCode = (text[0] - '0') * 100 + (text[1] - '0') * 10 + (text[2] - '0');
+    parseEnhancedStatus();
+}
+
+
+/**
+ * Position of the first byte of a line in the reply
+ */
+int SmtpReplyParser::lineStart(int index) const
+{
+    return index == 0 ? 0 : lineEnds[index - 1];
+}
+
+
+/**
+ * Looks for an enhanced status code "class.subject.detail" at the start of
+ * the text of the last line
+ */
+void SmtpReplyParser::parseEnhancedStatus()
+{
+    int start   = lineStart(numberOfLines - 1) + 4;
+    int end     = lineEnds[numberOfLines - 1];
+    int pos     = start;
+    if (pos >= end || (reply[pos] != '2' && reply[pos] != '4' && reply[pos] != '5')) return;
+    pos++;
+    for (int part{0}; part < 2; part++){
+        if (pos >= end || reply[pos] != '.') return;
+        pos++;
+        int digits{0};
+        while (pos < end && isDigit(reply[pos])){
+            pos++;
+            digits++;
+        }
+        if (digits == 0 || digits > 3) return;
+    }
+    if (pos < end && reply[pos] != ' ') return;
+    statusStart     = start;
+    statusLength    = pos - start;
+}
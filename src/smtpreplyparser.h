@@ -0,0 +1,81 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SMTPREPLYPARSER_H
+#define SMTPREPLYPARSER_H
+
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include <QLatin1String>
+
+/// Bytes read ahead from the socket, a power of 2
+#define SMTPREPLY_BUFFERSIZE    8192
+/// Bytes of one reply kept, the lines are truncated beyond
+#define SMTPREPLY_MAXSIZE       8192
+/// Lines of one reply kept, the last line is always kept
+#define SMTPREPLY_MAXLINES      64
+
+class SmtpReplyParser
+{
+public:
+    SmtpReplyParser();
+
+    qint64          readFrom(QIODevice* device);
+    bool            nextReply();
+    void            clear();
+
+    int             code() const;
+    QLatin1String   enhancedStatus() const;
+    int             lineCount() const;
+    QLatin1String   line(int index) const;
+    QString         text() const;
+    QStringList     lines() const;
+
+private:
+    char            ring[SMTPREPLY_BUFFERSIZE];
+    quint32         readPos{0};         ///< start of the first line not parsed yet
+    quint32         scanPos{0};         ///< next byte to check for the end of the line
+    quint32         writePos{0};        ///< end of the bytes read
+    bool            skipLine{false};    ///< rest of a line too long for the ring
+
+    char            reply[SMTPREPLY_MAXSIZE];
+    int             replySize{0};
+    int             lineEnds[SMTPREPLY_MAXLINES];
+    int             numberOfLines{0};
+    int             replyCode{0};
+    bool            replyComplete{false};
+    int             statusStart{0};
+    int             statusLength{0};
+
+    void            lineReceived(quint32 start, quint32 end);
+    int             lineStart(int index) const;
+    void            parseEnhancedStatus();
+};
+
+#endif // SMTPREPLYPARSER_H
@@ -0,0 +1,181 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tlssessioncache.h"
+
+/**
+  * @class TlsSessionCache
+  *
+  * @brief Process-wide cache of the TLS configuration and session of every mailserver.
+  *
+  * All connections of all Mailers to one server and port use the same
+  * QSslConfiguration, with the session of the last handshake to this server.
+  * The session is offered to the server when connecting again, and if it
+  * accepts it the handshake is resumed without the key exchange and the
+  * verification of the certificate chain.
+  *
+  * A session is offered for the lifetime the server gave with its ticket, or
+  * TLSSESSIONCACHE_MAXLIFETIME seconds if it gave none. With TLS 1.3 the
+  * server sends its session after the handshake, so Mailer passes the
+  * session again when it arrives.
+  *
+  * handshakes() counts the resumed and the full handshakes. Qt doesn't tell
+  * if a session was resumed, so a handshake counts as resumed if a session
+  * was offered and the session is unchanged after encrypted(). With TLS 1.2
+  * a server renewing the ticket while resuming is counted as full. With TLS
+  * 1.3 the new ticket only arrives after encrypted(), so a full handshake
+  * offering a session is counted as resumed; the count of resumed
+  * handshakes is an upper bound there.
+  *
+  * The cache can be used from several threads.
+  */
+
+
+/**
+ * The configuration to connect to a server with, holding the session of the
+ * last handshake if it hasn't expired
+ * @param server    name of the server
+ * @param port      port of the server
+ * @return configuration with session persistence enabled
+ */
+QSslConfiguration TlsSessionCache::configuration(const QString &server, int port)
+{
+    QMutexLocker locker(&mutex());
+    QString key = server.toLower() + ':' + QString::number(port);
+    QHash<QString, Entry>::iterator entry = cache().find(key);
+    if (entry == cache().end()){
+        if (cache().size() >= TLSSESSIONCACHE_MAXENTRIES) cache().clear();
+        Entry newEntry;
+        newEntry.configuration = QSslConfiguration::defaultConfiguration();
+        newEntry.configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        entry = cache().insert(key, newEntry);
+    }
+    if (!entry.value().configuration.sessionTicket().isEmpty() &&
+        entry.value().expires <= QDateTime::currentMSecsSinceEpoch())
+        entry.value().configuration.setSessionTicket(QByteArray());
+    return entry.value().configuration;
+}
+
+
+/**
+ * Counts a finished handshake and keeps its session for the next connections
+ * @param server            name of the server
+ * @param port              port of the server
+ * @param offeredSession    session of the configuration used to connect
+ * @param negotiated        configuration of the socket after encrypted()
+ * @return true if the handshake counts as resumed
+ */
+bool TlsSessionCache::handshakeFinished(const QString &server, int port,
+                                        const QByteArray &offeredSession,
+                                        const QSslConfiguration &negotiated)
+{
+    bool resumed = !offeredSession.isEmpty() && negotiated.sessionTicket() == offeredSession;
+    QMutexLocker locker(&mutex());
+    if (resumed)    resumedHandshakes()++;
+    else            fullHandshakes()++;
+    QHash<QString, Entry>::iterator entry = cache().find(server.toLower() + ':' + QString::number(port));
+    if (entry != cache().end()) storeSession(entry.value(), negotiated);
+    return resumed;
+}
+
+
+/**
+ * Keeps the session of a connection for the next connections, if it isn't
+ * the one cached already. Called after the handshake and whenever the
+ * server may have sent a new session.
+ * @param server        name of the server
+ * @param port          port of the server
+ * @param negotiated    configuration of the socket
+ */
+void TlsSessionCache::sessionNegotiated(const QString &server, int port,
+                                        const QSslConfiguration &negotiated)
+{
+    QMutexLocker locker(&mutex());
+    QHash<QString, Entry>::iterator entry = cache().find(server.toLower() + ':' + QString::number(port));
+    if (entry != cache().end()) storeSession(entry.value(), negotiated);
+}
+
+
+/**
+ * Returns the number of handshakes since the start of the process
+ * @return pair of <resumed handshakes, full handshakes>
+ */
+std::pair<int, int> TlsSessionCache::handshakes()
+{
+    QMutexLocker locker(&mutex());
+    return std::pair<int,int>(resumedHandshakes(), fullHandshakes());
+}
+
+
+/**
+ * Forgets the configurations and sessions of all servers
+ */
+void TlsSessionCache::clear()
+{
+    QMutexLocker locker(&mutex());
+    cache().clear();
+}
+
+
+void TlsSessionCache::storeSession(Entry &entry, const QSslConfiguration &negotiated)
+{
+    if (negotiated.sessionTicket().isEmpty() ||
+        negotiated.sessionTicket() == entry.configuration.sessionTicket()) return;
+    int lifetime = negotiated.sessionTicketLifeTimeHint();
+    if (lifetime <= 0) lifetime = TLSSESSIONCACHE_MAXLIFETIME;
+    entry.configuration.setSessionTicket(negotiated.sessionTicket());
+    entry.expires = QDateTime::currentMSecsSinceEpoch() + qint64(lifetime) * 1000;
+}
+
+
+QMutex& TlsSessionCache::mutex()
+{
+    static QMutex cacheMutex;
+    return cacheMutex;
+}
+
+
+QHash<QString, TlsSessionCache::Entry>& TlsSessionCache::cache()
+{
+    static QHash<QString, Entry> configurations;
+    return configurations;
+}
+
+
+int& TlsSessionCache::resumedHandshakes()
+{
+    static int resumed{0};
+    return resumed;
+}
+
+
+int& TlsSessionCache::fullHandshakes()
+{
+    static int full{0};
+    return full;
+}
@@ -0,0 +1,71 @@
+/*-
+ * Copyright (c) 2015, Martin Kropfinger
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TLSSESSIONCACHE_H
+#define TLSSESSIONCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QDateTime>
+#include <QSslConfiguration>
+#include <utility>
+
+/// Longest time in seconds a session is offered again, if the server gives no lifetime
+#define TLSSESSIONCACHE_MAXLIFETIME 3600
+/// Number of servers remembered before the cache is cleared
+#define TLSSESSIONCACHE_MAXENTRIES 256
+
+class TlsSessionCache
+{
+public:
+    static QSslConfiguration    configuration(const QString& server, int port);
+    static bool                 handshakeFinished(const QString& server, int port,
+                                                  const QByteArray& offeredSession,
+                                                  const QSslConfiguration& negotiated);
+    static void                 sessionNegotiated(const QString& server, int port,
+                                                  const QSslConfiguration& negotiated);
+    static std::pair<int,int>   handshakes();
+    static void                 clear();
+
+private:
+    /// Configuration shared by all connections to one server and when its session expires (msecs since epoch)
+    struct Entry {
+        QSslConfiguration   configuration;
+        qint64              expires{0};
+    };
+
+    static QMutex&                  mutex();
+    static QHash<QString, Entry>&   cache();
+    static int&                     resumedHandshakes();
+    static int&                     fullHandshakes();
+    static void                     storeSession(Entry& entry, const QSslConfiguration& negotiated);
+};
+
+#endif // TLSSESSIONCACHE_H